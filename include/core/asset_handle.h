@@ -0,0 +1,28 @@
+#ifndef ASSET_HANDLE_H
+#define ASSET_HANDLE_H
+
+#include <chrono>
+#include <future>
+#include <memory>
+
+/**
+ * @brief shared reference to an asset that may still be loading, get() returns the placeholder until it is ready.
+ */
+template<typename T>
+class AssetHandle {
+public:
+    AssetHandle() = default;
+    AssetHandle(std::shared_future<std::shared_ptr<T>> future, std::shared_ptr<T> placeholder)
+        : future_(std::move(future)), placeholder_(std::move(placeholder)) { }
+
+    [[nodiscard]] bool valid() const { return future_.valid(); }
+    [[nodiscard]] bool is_ready() const { return future_.valid() && future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+    [[nodiscard]] std::shared_ptr<T> get() const { return is_ready() ? future_.get() : placeholder_; }
+    [[nodiscard]] std::shared_ptr<T> wait() const { return future_.valid() ? future_.get() : placeholder_; }
+
+private:
+    std::shared_future<std::shared_ptr<T>> future_;
+    std::shared_ptr<T> placeholder_;
+};
+
+#endif //ASSET_HANDLE_H
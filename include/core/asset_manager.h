@@ -0,0 +1,57 @@
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "asset_handle.h"
+#include "buffer.h"
+#include "model.h"
+
+/**
+ * @brief loads every model and texture once per canonical path and hands out shared references to it.
+ * asynchronous loads run on the thread pool. a texture that fails to load is cached as nullptr, so it is not retried
+ * by every model that asks for it.
+ * blocking loads wait for a load already in flight, they must not be called from thread pool tasks for assets that
+ * were requested asynchronously.
+ */
+class AssetManager {
+public:
+    static AssetManager& Instance() {
+        static AssetManager instance;
+        return instance;
+    }
+
+    AssetHandle<Model> LoadModelAsync(const std::string &filename, MeshFormat format = FULL_PRECISION);
+    std::shared_ptr<Model> LoadModel(const std::string &filename, MeshFormat format = FULL_PRECISION);
+    // textures of handles that are still loading read as nullptr
+    AssetHandle<const ColorBuffer> LoadTextureAsync(const std::string &filename);
+    std::shared_ptr<const ColorBuffer> LoadTexture(const std::string &filename);
+
+    /**
+     * @brief model returned by handles whose model is still loading, nullptr (draw nothing) by default.
+     */
+    void SetPlaceholderModel(std::shared_ptr<Model> model);
+
+    /**
+     * @brief forgets every loaded asset nothing else references anymore, returns how many were released.
+     */
+    size_t ReleaseUnused();
+
+    AssetManager(const AssetManager&) = delete;
+    AssetManager& operator=(const AssetManager&) = delete;
+
+private:
+    AssetManager() = default;
+
+    static std::string GetKey(const std::string &filename);
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<Model>>> models_;
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<const ColorBuffer>>> textures_;
+    std::shared_ptr<Model> placeholder_model_;
+};
+
+#endif //ASSET_MANAGER_H
@@ -1,10 +1,68 @@
 #ifndef IMAGE_BUFFER_H
 #define IMAGE_BUFFER_H
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include "color.h"
 #include "maths/matrix.h"
 
+/**
+ * @brief per-tile flags telling which tiles of a buffer still hold the clear value without it being written.
+ * clearing only sets the flags, a tile is filled on its first write and reads of untouched tiles return the clear value.
+ * flags are bytes rather than bits so that threads working on different tiles never write the same word.
+ */
+class TileClearState {
+public:
+    static constexpr size_t kTileSize = 64;
+
+    TileClearState() = default;
+    TileClearState(size_t width, size_t height);
+
+    void MarkAll() const;
+
+    [[nodiscard]] bool pending() const { return pending_; }
+    [[nodiscard]] bool IsCleared(const size_t x, const size_t y) const { return pending_ && flags_[TileIndex(x, y)]; }
+
+    // fill(x0, x1, y0, y1) writes the clear value into the half-open rectangle of a tile
+    template<typename F>
+    void Materialize(const size_t x, const size_t y, F &&fill) const {
+        if (!pending_) return;
+        const size_t tile = TileIndex(x, y);
+        if (!flags_[tile]) return;
+        FillTile(tile, fill);
+        flags_[tile] = 0;
+    }
+
+    template<typename F>
+    void Resolve(F &&fill) const {
+        if (!pending_) return;
+        for (size_t tile = 0; tile < tiles_x_ * tiles_y_; ++tile) {
+            if (!flags_[tile]) continue;
+            FillTile(tile, fill);
+            flags_[tile] = 0;
+        }
+        pending_ = false;
+    }
+
+private:
+    [[nodiscard]] size_t TileIndex(const size_t x, const size_t y) const { return y / kTileSize * tiles_x_ + x / kTileSize; }
+
+    template<typename F>
+    void FillTile(const size_t tile, F &fill) const {
+        const size_t x0 = tile % tiles_x_ * kTileSize, y0 = tile / tiles_x_ * kTileSize;
+        fill(x0, std::min(x0 + kTileSize, width_), y0, std::min(y0 + kTileSize, height_));
+    }
+
+    size_t width_ = 0;
+    size_t height_ = 0;
+    size_t tiles_x_ = 0;
+    size_t tiles_y_ = 0;
+    std::unique_ptr<std::uint8_t[]> flags_;
+    mutable bool pending_ = false;
+};
+
 /**
  * @brief enum of bytes per pixel.
  */
@@ -15,36 +73,72 @@ enum ColorType {
 };
 
 /**
- * @brief buffer of a color image
+ * @brief buffer of a color image, or a view of the pixels of another image or of a mapped file.
+ * pixel (x, y) lives at origin + y * row_stride + x * pixel_stride, both strides are signed, so flips and crops only
+ * change the view and never move pixels. views share the pixels of their source but keep their own lazy clear state.
  */
 class ColorBuffer {
 public:
     ColorBuffer();
     ColorBuffer(size_t width, size_t height, uint8_t bpp = RGBA);
+    /**
+     * @brief read-only view of pixels owned by storage, with rows row_stride bytes apart.
+     */
+    ColorBuffer(const std::uint8_t *origin, size_t width, size_t height, uint8_t bpp, std::ptrdiff_t row_stride, std::shared_ptr<const void> storage);
 
     std::uint8_t& operator[](size_t index);
     std::uint8_t  operator[](size_t index) const;
 
     void SetPixel(size_t x, size_t y, const Color &color) const;
+    // writes row y from width() packed pixels
+    void SetRow(size_t y, const std::uint8_t *pixels) const;
+    // reads the first count pixels of row y as packed pixels, lazily cleared tiles are read without being filled
+    void GetRow(size_t y, std::uint8_t *pixels, size_t count) const;
     [[nodiscard]] Color GetPixel(size_t x, size_t y) const;
     [[nodiscard]] Color GetPixel(Vector2f uv) const;
 
     void FlipVertically();
     void FlipHorizontally();
+    /**
+     * @brief view of the rectangle [x, x + width) x [y, y + height) of this buffer, sharing its pixels.
+     */
+    [[nodiscard]] ColorBuffer View(size_t x, size_t y, size_t width, size_t height) const;
+    // copies the pixels into a packed top-down image of size() bytes
+    void CopyTo(std::uint8_t *out) const;
     void Clear(uint8_t value = 0) const;
+    void Resolve() const;
 
     [[nodiscard]] size_t width() const { return width_; }
     [[nodiscard]] size_t height() const { return height_; }
     [[nodiscard]] std::uint8_t bpp() const { return bpp_; }
     [[nodiscard]] size_t size() const { return width_ * height_ * bpp_; }
-    [[nodiscard]] const std::uint8_t* data() const { return data_.get(); }
-    [[nodiscard]]       std::uint8_t* data()       { return data_.get(); }
+    [[nodiscard]] std::ptrdiff_t row_stride() const { return row_stride_; }
+    [[nodiscard]] std::ptrdiff_t pixel_stride() const { return pixel_stride_; }
+    [[nodiscard]] bool read_only() const { return read_only_; }
+    // packed top-down rows, the only layout raw access can export
+    [[nodiscard]] bool is_contiguous() const { return pixel_stride_ == bpp_ && row_stride_ == static_cast<std::ptrdiff_t>(width_ * bpp_); }
+    // address of pixel (0, y)
+    [[nodiscard]] const std::uint8_t* row(const size_t y) const { Resolve(); return origin_ + static_cast<std::ptrdiff_t>(y) * row_stride_; }
+    // raw access exports the buffer, lazily cleared tiles are filled first
+    [[nodiscard]] const std::uint8_t* data() const { assert(is_contiguous()); Resolve(); return origin_; }
+    [[nodiscard]]       std::uint8_t* data()       { assert(is_contiguous() && !read_only_); Resolve(); return origin_; }
 
 private:
+    [[nodiscard]] std::uint8_t* Pixel(const size_t x, const size_t y) const {
+        return origin_ + static_cast<std::ptrdiff_t>(y) * row_stride_ + static_cast<std::ptrdiff_t>(x) * pixel_stride_;
+    }
+    void FillRect(size_t x0, size_t x1, size_t y0, size_t y1) const;
+
     size_t width_;
     size_t height_;
     std::uint8_t bpp_;
-    std::unique_ptr<std::uint8_t[]> data_;
+    std::ptrdiff_t row_stride_ = 0;
+    std::ptrdiff_t pixel_stride_ = 0;
+    std::uint8_t *origin_ = nullptr;
+    std::shared_ptr<const void> storage_;   // keeps the pixels alive, shared by every view of them
+    bool read_only_ = false;
+    TileClearState clear_state_;
+    mutable std::uint8_t clear_value_ = 0;
 };
 
 /**
@@ -62,29 +156,35 @@ public:
     [[nodiscard]] float Get(size_t x, size_t y) const;
 
     void Clear(float value = std::numeric_limits<float>::max()) const;
+    void Resolve() const;
 
     [[nodiscard]] size_t width() const { return width_; }
     [[nodiscard]] size_t height() const { return height_; }
     [[nodiscard]] size_t size() const { return width_ * height_; }
-    [[nodiscard]] const float* data() const { return data_.get(); }
-    [[nodiscard]]       float* data()       { return data_.get(); }
+    [[nodiscard]] const float* data() const { Resolve(); return data_.get(); }
+    [[nodiscard]]       float* data()       { Resolve(); return data_.get(); }
 
 private:
+    void FillRect(size_t x0, size_t x1, size_t y0, size_t y1) const;
+
     size_t width_;
     size_t height_;
     std::unique_ptr<float[]> data_;
+    TileClearState clear_state_;
+    mutable float clear_value_ = std::numeric_limits<float>::max();
 };
 
 template <size_t N>
 class VectorBuffer {
 public:
-    VectorBuffer(const size_t width, const size_t height) : width_(width), height_(height), data_(std::make_unique<float[]>(width * height * N)) {
-        Clear();
+    VectorBuffer(const size_t width, const size_t height)
+        : width_(width), height_(height), data_(std::make_unique<float[]>(width * height * N)), clear_state_(width, height) {
     }
 
     void Set(const size_t x, const size_t y, const Vector<float, N> &vector) const {
         assert(x < width_ && y < height_ && data_ != nullptr);
-        const int offset = (y * width_ + x) * N;
+        clear_state_.Materialize(x, y, [this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
+        const size_t offset = (y * width_ + x) * N;
         std::copy_n(vector.data.begin(), N, data_.get() + offset);
     }
 
@@ -97,31 +197,121 @@ public:
     [[nodiscard]] Vector<float, N> Get(const size_t x, const size_t y) const {
         assert(x < width_ && y < height_ && data_ != nullptr);
         Vector<float, N> vector;
-        const int offset = (y * width_ + x) * N;
+        if (clear_state_.IsCleared(x, y)) {
+            vector.data.fill(clear_value_);
+            return vector;
+        }
+        const size_t offset = (y * width_ + x) * N;
         std::copy_n(data_.get() + offset, N, vector.data.begin());
         return vector;
     }
 
     void Clear(const float value = 0) const {
-        std::fill_n(data_.get(), width_ * height_ * N, value);
+        clear_value_ = value;
+        clear_state_.MarkAll();
+    }
+
+    void Resolve() const {
+        clear_state_.Resolve([this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
     }
 
     [[nodiscard]] size_t width() const { return width_; }
     [[nodiscard]] size_t height() const { return height_; }
     [[nodiscard]] size_t size() const { return width_ * height_ * N; }
-    [[nodiscard]] const float* data() const { return data_.get(); }
-    [[nodiscard]]       float* data()       { return data_.get(); }
+    [[nodiscard]] const float* data() const { Resolve(); return data_.get(); }
+    [[nodiscard]]       float* data()       { Resolve(); return data_.get(); }
 private:
+    void FillRect(const size_t x0, const size_t x1, const size_t y0, const size_t y1) const {
+        for (size_t y = y0; y < y1; ++y)
+            std::fill_n(data_.get() + (y * width_ + x0) * N, (x1 - x0) * N, clear_value_);
+    }
+
     size_t width_;
     size_t height_;
     std::unique_ptr<float[]> data_;
+    TileClearState clear_state_;
+    mutable float clear_value_ = 0;
+};
+
+/**
+ * @brief coverage and depth of every sample of a multisampled frame.
+ * depth is kept per sample at full precision. color is not: a pixel holds a palette of two colors and a bit per sample
+ * selecting one of them, which covers the common case of one edge crossing the pixel. fragments are still shaded once
+ * per pixel and the g-buffer and overdraw counters stay per pixel.
+ */
+class MultisampleBuffer {
+public:
+    static constexpr size_t kMaxSamples = 8;
+
+    struct Pixel {
+        std::array<Color, 2> palette;
+        std::uint8_t mask = 0;      // bit s set: sample s shows palette[1]
+        std::uint8_t known = 0xff;  // bit s clear: the color of sample s was evicted, the resolve leaves it out
+
+        /**
+         * @brief gives the samples in written the color. when the samples left over still show two different colors,
+         * the one held by fewer of them is evicted, averaging it in instead would let hidden surfaces bleed through.
+         */
+        void Write(std::uint32_t written, const Color &color, size_t samples);
+        [[nodiscard]] Color Resolve(size_t samples) const;
+    };
+
+    MultisampleBuffer(size_t width, size_t height, size_t samples);
+
+    /**
+     * @brief standard sample pattern of a sample count (1, 2, 4 or 8), offsets from the pixel position in pixels.
+     */
+    static const Vector2f* GetSamplePositions(size_t samples);
+
+    // color palette and sample depths of pixel (x, y), lazily cleared tiles are filled first
+    [[nodiscard]] Pixel* pixel(size_t x, size_t y) const;
+    [[nodiscard]] float* depths(size_t x, size_t y) const;
+    [[nodiscard]] bool IsCleared(const size_t x, const size_t y) const { return clear_state_.IsCleared(x, y); }
+
+    void Clear(uint8_t color = 0, float depth = std::numeric_limits<float>::max()) const;
+    void Resolve() const;
+
+    [[nodiscard]] size_t width() const { return width_; }
+    [[nodiscard]] size_t height() const { return height_; }
+    [[nodiscard]] size_t samples() const { return samples_; }
+    [[nodiscard]] const Vector2f* sample_positions() const { return GetSamplePositions(samples_); }
+
+private:
+    void FillRect(size_t x0, size_t x1, size_t y0, size_t y1) const;
+
+    size_t width_;
+    size_t height_;
+    size_t samples_;
+    std::unique_ptr<Pixel[]> pixels_;
+    std::unique_ptr<float[]> depths_;
+    TileClearState clear_state_;
+    mutable uint8_t clear_color_ = 0;
+    mutable float clear_depth_ = std::numeric_limits<float>::max();
 };
 
 struct FrameBuffer {
-    FrameBuffer(size_t width, size_t height, uint8_t bpp = RGBA);
+    FrameBuffer(size_t width, size_t height, uint8_t bpp = RGBA, size_t samples = 1);
 
     void Clear(uint8_t default_color = 0, float default_depth = std::numeric_limits<float>::max()) const;
+    void Resolve() const;
+
+    /**
+     * @brief renders into per-sample storage from now on, 1 turns multisampling off. Renderer::ResolveMultisample
+     * writes the samples into the color and depth buffers.
+     */
+    void SetSampleCount(size_t samples);
+    [[nodiscard]] size_t samples() const { return multisample != nullptr ? multisample->samples() : 1; }
+
+    /**
+     * @brief renders into the top-left width x height pixels only, the viewport matrix follows. Renderer::Upscale
+     * stretches them over the color buffer, depth and g-buffer keep the rendered size.
+     */
+    void SetRenderSize(size_t width, size_t height);
+    [[nodiscard]] size_t render_width() const { return render_width_; }
+    [[nodiscard]] size_t render_height() const { return render_height_; }
+    [[nodiscard]] bool is_scaled() const { return render_width_ != width() || render_height_ != height(); }
 
+    // viewport of the render size
     [[nodiscard]] Matrix4x4 GetViewportMatrix() const;
     [[nodiscard]] static Matrix4x4 GetViewportMatrix(size_t x, size_t y, size_t w, size_t h);
 
@@ -130,6 +320,12 @@ struct FrameBuffer {
 
     ColorBuffer color_buffer;
     DepthBuffer depth_buffer;
+    // only allocated while multisampling is on
+    std::unique_ptr<MultisampleBuffer> multisample;
+
+private:
+    size_t render_width_;
+    size_t render_height_;
 };
 
 struct GBuffer {
@@ -137,9 +333,30 @@ struct GBuffer {
 
     void Clear() const {
         normal.Clear();
+        if (overdraw != nullptr) overdraw->Clear();
+    }
+
+    void EnableOverdraw(const bool enable) {
+        if (enable && overdraw == nullptr) overdraw = std::make_unique<VectorBuffer<2>>(normal.width(), normal.height());
+        else if (!enable) overdraw.reset();
     }
 
     VectorBuffer<3> normal;
+    // depth tests and fragment shader invocations per pixel, only allocated while the overdraw view is on
+    std::unique_ptr<VectorBuffer<2>> overdraw;
+};
+
+/**
+ * @brief whole frame statistics of the overdraw view.
+ */
+struct OverdrawStats {
+    size_t covered_pixels = 0;
+    size_t depth_tests = 0;
+    size_t fragments = 0;
+    float max_overdraw = 0;
+
+    [[nodiscard]] float mean_overdraw() const { return covered_pixels ? static_cast<float>(fragments) / static_cast<float>(covered_pixels) : 0.0f; }
+    [[nodiscard]] float depth_rejected_percent() const { return depth_tests ? 100.0f * static_cast<float>(depth_tests - fragments) / static_cast<float>(depth_tests) : 0.0f; }
 };
 
 #endif //IMAGE_BUFFER_H
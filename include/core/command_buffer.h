@@ -0,0 +1,47 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ishader.h"
+
+/**
+ * @brief a recorded draw of a model with a shader at a given transform.
+ */
+struct DrawCommand {
+    std::shared_ptr<const Model> model;
+    std::shared_ptr<const IShader> shader;
+    Matrix4x4 model_matrix;
+    std::uint64_t sort_key = 0;
+    std::uint32_t order = 0;    // recording order, keeps the sort stable
+};
+
+/**
+ * @brief list of draw commands recorded first and executed later.
+ * sorting groups the (opaque) commands by shader and material (model) and orders each group front-to-back,
+ * so that consecutive commands become instanced draws and the depth test rejects hidden fragments early.
+ * a command buffer can be kept and replayed across frames, only the sort has to be redone when the view changes.
+ */
+class CommandBuffer {
+public:
+    void Record(const std::shared_ptr<const Model> &model, const std::shared_ptr<const IShader> &shader, const Matrix4x4 &model_matrix);
+    void Clear();
+
+    void Sort(const Matrix4x4 &view_matrix);
+    // the instance lists use the allocator of draws
+    void Build(const std::shared_ptr<const FrameState> &frame, ArenaVector<DrawState> &draws) const;
+
+    [[nodiscard]] size_t size() const { return commands_.size(); }
+    [[nodiscard]] bool empty() const { return commands_.empty(); }
+    [[nodiscard]] const std::vector<DrawCommand>& commands() const { return commands_; }
+
+private:
+    std::vector<DrawCommand> commands_;
+    std::vector<const IShader*> shader_ids_;    // scratch of Sort, kept to reuse its memory
+    std::vector<const Model*> model_ids_;
+    Matrix4x4 sorted_view_matrix_;
+    bool sorted_ = false;
+};
+
+#endif //COMMAND_BUFFER_H
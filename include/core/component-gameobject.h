@@ -1,9 +1,13 @@
 #ifndef GAME_OBJECT_H
 #define GAME_OBJECT_H
 
+#include <span>
 #include <utility>
+#include <vector>
+#include "asset_manager.h"
 #include "model.h"
 #include "maths/maths.h"
+#include "utility/frame_arena.h"
 
 class Component {
 public:
@@ -15,30 +19,54 @@ private:
     std::string name_;
 };
 
+/**
+ * @brief local transform of a game object, the local matrix is cached and only rebuilt after a change.
+ * modifications go through GameObject so that the hierarchy can be invalidated as well.
+ */
 class Transform : public Component {
 public:
     Transform() : Component("Transform") { }
 
-    [[nodiscard]] Matrix4x4 GetModelMatrix() const;
+    [[nodiscard]] const Matrix4x4& GetModelMatrix() const;
 
-    Vector3f position {0, 0, 0};
-    Vector3f rotation {0, 0, 0};
-    Vector3f scale {1, 1, 1};
+    [[nodiscard]] const Vector3f& position() const { return position_; }
+    [[nodiscard]] const Vector3f& rotation() const { return rotation_; }
+    [[nodiscard]] const Vector3f& scale() const { return scale_; }
+
+private:
+    friend struct GameObject;
+
+    void SetPosition(const Vector3f& position) { position_ = position; dirty_ = true; }
+    void SetRotation(const Vector3f& rotation) { rotation_ = rotation; dirty_ = true; }
+    void SetScale(const Vector3f& scale) { scale_ = scale; dirty_ = true; }
+
+    Vector3f position_ {0, 0, 0};
+    Vector3f rotation_ {0, 0, 0};
+    Vector3f scale_ {1, 1, 1};
+    mutable Matrix4x4 local_matrix_;
+    mutable bool dirty_ = true;
 };
 
 class Mesh : public Component {
 public:
     Mesh()                                              : Component("Mesh"), model_(nullptr) { }
-    Mesh(const Mesh& other)                             : Component("Mesh"), model_(other.model_) { }
+    Mesh(const Mesh& other)                             : Component("Mesh"), model_(other.model_), pending_(other.pending_) { }
     explicit Mesh(const std::shared_ptr<Model>& model)  : Component("Mesh"), model_(model) { }
-    explicit Mesh(const std::string& filename)          : Component("Mesh"), model_(std::make_shared<Model>(filename)) { }
+    explicit Mesh(AssetHandle<Model> model)             : Component("Mesh"), model_(nullptr), pending_(std::move(model)) { }
+    explicit Mesh(const std::string& filename, const MeshFormat format = FULL_PRECISION)
+        : Component("Mesh"), model_(AssetManager::Instance().LoadModel(filename, format)) { }
 
-    void SetModel(const std::shared_ptr<Model>& model) { model_ = model; }
+    void SetModel(const std::shared_ptr<Model>& model) { model_ = model; pending_ = {}; }
 
-    [[nodiscard]] std::shared_ptr<Model> model() const { return model_; }
+    /**
+     * @brief the model, or the placeholder of the asset manager while it is still loading.
+     */
+    [[nodiscard]] std::shared_ptr<Model> model() const { return pending_.valid() ? pending_.get() : model_; }
+    [[nodiscard]] bool is_loading() const { return pending_.valid() && !pending_.is_ready(); }
 
 private:
     std::shared_ptr<Model> model_;
+    AssetHandle<Model> pending_;
 };
 
 class Camera : public Component {
@@ -56,27 +84,61 @@ public:
 };
 
 
+/**
+ * @brief node of the scene graph. the world matrix is cached and invalidated by dirty flags,
+ * a node that has not moved (and whose ancestors have not moved) costs nothing to update.
+ */
 struct GameObject {
     explicit GameObject(std::string name = "GameObject") : name(std::move(name)) { }
+    virtual ~GameObject() = default;
+
+    GameObject(const GameObject&) = delete;
+    GameObject& operator=(const GameObject&) = delete;
 
     std::string name;
     Transform transform;
 
-    void SetPosition(const Vector3f& position) { transform.position = position; }
-    void SetRotation(const Vector3f& rotation) { transform.rotation = rotation; }
-    void SetScale(const Vector3f& scale) { transform.scale = scale; }
+    void SetPosition(const Vector3f& position) { transform.SetPosition(position); MarkDirty(); }
+    void SetRotation(const Vector3f& rotation) { transform.SetRotation(rotation); MarkDirty(); }
+    void SetScale(const Vector3f& scale) { transform.SetScale(scale); MarkDirty(); }
+
+    [[nodiscard]] Vector3f GetPosition() const { return transform.position(); }
+    [[nodiscard]] Vector3f GetRotation() const { return transform.rotation(); }
+    [[nodiscard]] Vector3f GetScale() const { return transform.scale(); }
 
-    [[nodiscard]] Vector3f GetPosition() const { return transform.position; }
-    [[nodiscard]] Vector3f GetRotation() const { return transform.rotation; }
-    [[nodiscard]] Vector3f GetScale() const { return transform.scale; }
+    [[nodiscard]] const Matrix4x4& GetLocalMatrix() const { return transform.GetModelMatrix(); }
+    [[nodiscard]] const Matrix4x4& GetModelMatrix() const;
 
-    [[nodiscard]] Matrix4x4 GetModelMatrix() const { return transform.GetModelMatrix(); }
+    void AddChild(const std::shared_ptr<GameObject>& child);
+    void RemoveChild(const std::shared_ptr<GameObject>& child);
+
+    [[nodiscard]] GameObject* parent() const { return parent_; }
+    [[nodiscard]] const std::vector<std::shared_ptr<GameObject>>& children() const { return children_; }
+
+    /**
+     * @brief breadth-first update of the world matrices below the given roots.
+     * only dirty subtrees are visited, nodes of the same depth are updated in parallel.
+     */
+    static void UpdateHierarchy(std::span<GameObject* const> roots, FrameArena* arena = nullptr);
+
+private:
+    void MarkDirty();
+    void UpdateWorldMatrix() const;
+    [[nodiscard]] bool IsWorldDirty() const;
+
+    GameObject* parent_ = nullptr;
+    std::vector<std::shared_ptr<GameObject>> children_{};
+    mutable Matrix4x4 world_matrix_;
+    mutable bool world_dirty_ = true;       // world matrix of this node is stale
+    mutable bool subtree_dirty_ = true;     // this node or one of its descendants is stale
 };
 
 struct MeshObject : GameObject {
     explicit MeshObject(std::string name = "MeshObject") : GameObject(std::move(name)) { }
 
     std::shared_ptr<Mesh> mesh;
+    bool is_static = false; // recorded once and replayed by the scene, see Scene::InvalidateStaticCommands
+
 };
 
 struct CameraObject : GameObject {
@@ -0,0 +1,86 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "buffer.h"
+
+/**
+ * @brief what Capture does when every snapshot is still waiting to be written.
+ */
+enum CapturePolicy {
+    CAPTURE_BLOCK,  // wait for the writer, rendering slows down to the encode speed
+    CAPTURE_DROP    // skip the frame and count it as dropped
+};
+
+/**
+ * @brief copy of one frame waiting to be written.
+ */
+struct FrameSnapshot {
+    FrameSnapshot(size_t width, size_t height, bool with_depth, bool with_normal);
+
+    ColorBuffer color;
+    std::unique_ptr<float[]> depth;
+    std::unique_ptr<float[]> normal;
+    bool has_depth = false;
+    bool has_normal = false;
+    size_t frame_index = 0;
+};
+
+/**
+ * @brief writes frames to .tga files without stalling the render loop.
+ * Capture copies the frame into one of the preallocated snapshots and returns, a writer thread encodes the snapshot
+ * and hands it back to the pool. the output pattern replaces a run of '#' by the zero padded frame index, depth and
+ * normals go next to the color image with a "_depth" and "_normal" suffix.
+ */
+class FrameCapture {
+public:
+    FrameCapture(size_t width, size_t height, size_t pool_size, CapturePolicy policy, std::string output_pattern,
+                 bool capture_depth = false, bool capture_normal = false, bool rle = true);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    /**
+     * @brief snapshots the frame, returns false if it was dropped. the g-buffer is only needed for normals.
+     */
+    bool Capture(const FrameBuffer &frame_buffer, const GBuffer *g_buffer = nullptr);
+    void Flush();
+
+    [[nodiscard]] size_t captured() const { return captured_; }
+    [[nodiscard]] size_t written() const { return written_; }
+    [[nodiscard]] size_t dropped() const { return dropped_; }
+    [[nodiscard]] size_t failed() const { return failed_; }
+
+private:
+    void WriteLoop();
+    bool Write(const FrameSnapshot &snapshot) const;
+    [[nodiscard]] std::string GetOutputPath(size_t frame_index, const std::string &suffix = "") const;
+
+    size_t width_;
+    size_t height_;
+    CapturePolicy policy_;
+    std::string output_pattern_;
+    bool rle_;
+    std::vector<std::unique_ptr<FrameSnapshot>> snapshots_;
+    std::queue<FrameSnapshot*> free_queue_;
+    std::queue<FrameSnapshot*> write_queue_;
+    size_t frame_count_ = 0;
+    std::atomic<size_t> captured_ = 0;
+    std::atomic<size_t> written_ = 0;
+    std::atomic<size_t> dropped_ = 0;
+    std::atomic<size_t> failed_ = 0;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_ = false;
+    std::thread write_thread_;
+};
+
+#endif //FRAME_CAPTURE_H
@@ -0,0 +1,82 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "buffer.h"
+
+/**
+ * @brief one set of render targets cycling through the frame pipeline.
+ */
+struct FrameSlot {
+    std::shared_ptr<FrameBuffer> frame_buffer;
+    std::shared_ptr<GBuffer> g_buffer;
+    std::string ui_text;
+    size_t frame_index = 0;
+};
+
+/**
+ * @brief hands frames from a render thread to the window thread, so frame N is presented while frame N + 1 renders.
+ * a slot goes free -> rendering (render thread) -> resolving (worker) -> presenting (window thread) -> clearing
+ * (worker) -> free. the worker fills the lazily cleared tiles of the color buffer before the slot is presented, so
+ * the window thread only copies pixels. with a queue depth of N at most N frames are in flight, a depth of 1 has no
+ * worker and resolves on the render thread and clears on the window thread.
+ */
+class FramePipeline {
+public:
+    FramePipeline(size_t width, size_t height, size_t queue_depth);
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // render thread, nullptr once the pipeline is closed
+    FrameSlot* AcquireFrame();
+    void SubmitFrame(FrameSlot &slot);
+    // window thread, nullptr once the pipeline is closed
+    FrameSlot* AcquirePresent();
+    void ReleasePresent(FrameSlot &slot);
+    // wakes every waiting thread, frames still in flight are dropped
+    void Close();
+
+    [[nodiscard]] size_t queue_depth() const { return slots_.size(); }
+
+private:
+    /**
+     * @brief fifo of slots with room for every slot, so passing slots between the stages never allocates.
+     */
+    class SlotQueue {
+    public:
+        void Reserve(const size_t capacity) { slots_.resize(capacity); }
+        void push(FrameSlot *slot) { slots_[(head_ + size_++) % slots_.size()] = slot; }
+        void pop() { head_ = (head_ + 1) % slots_.size(); size_--; }
+        [[nodiscard]] FrameSlot* front() const { return slots_[head_]; }
+        [[nodiscard]] bool empty() const { return size_ == 0; }
+
+    private:
+        std::vector<FrameSlot*> slots_;
+        size_t head_ = 0;
+        size_t size_ = 0;
+    };
+
+    static void Resolve(const FrameSlot &slot);
+    static void Clear(const FrameSlot &slot);
+    void WorkerLoop();
+
+    std::vector<FrameSlot> slots_;
+    SlotQueue free_queue_;
+    SlotQueue resolve_queue_;
+    SlotQueue present_queue_;
+    SlotQueue clear_queue_;
+    size_t frame_count_ = 0;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_ = false;
+    std::thread worker_thread_;
+};
+
+#endif //FRAME_PIPELINE_H
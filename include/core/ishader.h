@@ -5,11 +5,56 @@
 #include <memory>
 #include "color.h"
 #include <vector>
+#include "utility/frame_arena.h"
+
+struct IShader;
+
+struct Light {
+    Vector3f direction;
+    Vector3f intensity;
+};
+
+/**
+ * @brief per-instance transforms, computed once per instance instead of once per vertex.
+ */
+struct InstanceTransform {
+    Matrix4x4 model_matrix;
+    Matrix4x4 model_view_matrix;
+    Matrix4x4 normal_matrix; // inverse transpose of model_view_matrix
+
+    static InstanceTransform Create(const Matrix4x4 &model_matrix, const Matrix4x4 &view_matrix);
+};
+
+/**
+ * @brief camera and lighting state shared by all draws of a frame.
+ */
+struct FrameState {
+    Matrix4x4 view_matrix;
+    Matrix4x4 projection_matrix;
+    Matrix4x4 viewport_matrix;
+    std::vector<Light> lights{};
+    Vector3f view_direction;
+
+    void NormalizeLights();
+};
+
+/**
+ * @brief immutable snapshot of everything a draw needs, shaders only read from it.
+ * draws never share mutable state, so they can be processed concurrently.
+ */
+struct DrawState {
+    std::shared_ptr<const FrameState> frame;
+    std::shared_ptr<const IShader> shader;
+    std::shared_ptr<const Model> model;
+    ArenaVector<InstanceTransform> instances{};
+};
 
 struct VertexShaderInput {
     Vector3f vertex_model_space;
     Vector3f normal;
     Vector2f uv;
+    const InstanceTransform &instance;
+    const DrawState &state;
 };
 
 struct Vertex {
@@ -25,6 +70,7 @@ struct Vertex {
 struct FragmentShaderInput {
     const std::array<Vertex, 3> &triangle;
     Vector3f &bc_clip;
+    const DrawState &state;
 };
 
 struct FragmentShaderOutput {
@@ -32,40 +78,30 @@ struct FragmentShaderOutput {
     Vector3f normal;
 };
 
-struct Light {
-    Vector3f direction;
-    Vector3f intensity;
-};
-
+/**
+ * @brief shaders are stateless during rendering, per-draw data comes from the DrawState of their inputs.
+ */
 struct IShader {
     virtual ~IShader() = default;
 
-    void NormalizeLights();
-
     virtual void VertexShader(const VertexShaderInput& in, Vertex& out) const = 0;
     virtual bool Fragment(const FragmentShaderInput& in, FragmentShaderOutput &out) const = 0;
 
-    void Deferred(const GBuffer &g_buffer, const FrameBuffer &frame_buffer) const;
+    void Deferred(const FrameState &frame, const GBuffer &g_buffer, const FrameBuffer &frame_buffer) const;
 
     std::string name;
-    Matrix4x4 model_matrix;
-    Matrix4x4 view_matrix;
-    Matrix4x4 projection_matrix;
-    Matrix4x4 viewport_matrix;
-    std::vector<Light> lights{};
-    std::shared_ptr<Model> model = nullptr;
-    Vector3f view_direction;
+    std::uint32_t texture_slots; // TextureSlot mask of the model maps the shader samples, loaded before it draws
     float ambient_light = 0.1f;
 
 protected:
-    explicit IShader(std::string name) : name(std::move(name)) { }
+    explicit IShader(std::string name, const std::uint32_t texture_slots = 0) : name(std::move(name)), texture_slots(texture_slots) { }
 };
 
 struct StandardVertexShader : IShader {
     void VertexShader(const VertexShaderInput& in, Vertex& out) const override;
 
 protected:
-    explicit StandardVertexShader(std::string name) : IShader(std::move(name)) { }
+    explicit StandardVertexShader(std::string name, const std::uint32_t texture_slots = 0) : IShader(std::move(name), texture_slots) { }
 };
 
 struct FixedShader final :StandardVertexShader {
@@ -81,31 +117,31 @@ struct GrayShader final : StandardVertexShader {
 };
 
 struct PhongShader final : StandardVertexShader {
-    PhongShader() : StandardVertexShader("Phong") { }
+    PhongShader() : StandardVertexShader("Phong", DIFFUSE_MAP | SPECULAR_MAP) { }
 
     bool Fragment(const FragmentShaderInput& in, FragmentShaderOutput &out) const override;
 };
 
 struct BlinnPhongShader final : StandardVertexShader {
-    BlinnPhongShader() : StandardVertexShader("BlinnPhong") { }
+    BlinnPhongShader() : StandardVertexShader("BlinnPhong", DIFFUSE_MAP | SPECULAR_MAP) { }
 
     bool Fragment(const FragmentShaderInput& in, FragmentShaderOutput &out) const override;
 };
 
 struct NormalShader final : StandardVertexShader {
-    NormalShader() : StandardVertexShader("Normal") { }
+    NormalShader() : StandardVertexShader("Normal", DIFFUSE_MAP | NORMAL_MAP) { }
 
     bool Fragment(const FragmentShaderInput& in, FragmentShaderOutput &out) const override;
 };
 
 struct NormalTangentShader final : StandardVertexShader {
-    NormalTangentShader() : StandardVertexShader("Tangent") { }
+    NormalTangentShader() : StandardVertexShader("Tangent", DIFFUSE_MAP | SPECULAR_MAP | NORMAL_MAP_TANGENT) { }
 
     bool Fragment(const FragmentShaderInput& in, FragmentShaderOutput &out) const override;
 };
 
 struct DeferredShader final : StandardVertexShader {
-    DeferredShader() : StandardVertexShader("Deferred") { }
+    DeferredShader() : StandardVertexShader("Deferred", DIFFUSE_MAP) { }
 
     bool Fragment(const FragmentShaderInput& in, FragmentShaderOutput &out) const override;
 };
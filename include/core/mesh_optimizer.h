@@ -0,0 +1,48 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "model.h"
+
+/**
+ * @brief load-time mesh processing: welding of attribute tuples and reordering for the vertex caches.
+ */
+class MeshOptimizer {
+public:
+    MeshOptimizer() = delete;
+
+    static constexpr size_t kCacheSize = 16; // entries of the renderer's post-transform vertex cache
+
+    /**
+     * @brief merges every unique (position, uv, normal) index tuple into one interleaved vertex, so a single index
+     * buffer addresses all attributes.
+     */
+    static void Weld(const MeshArrays &mesh, std::vector<MeshVertex> &vertices, std::vector<std::uint32_t> &indices);
+
+    /**
+     * @brief reorders the triangles for a fifo post-transform cache of cache_size entries (tipsify, Sander et al. 2007).
+     */
+    static void OptimizeVertexCache(std::vector<std::uint32_t> &indices, size_t vertex_count, size_t cache_size = kCacheSize);
+
+    /**
+     * @brief reorders the vertices by first use in the index buffer, so fetches walk the vertex array forwards.
+     */
+    static void OptimizeVertexFetch(std::vector<MeshVertex> &vertices, std::vector<std::uint32_t> &indices);
+
+    /**
+     * @brief average cache miss ratio, transformed vertices per triangle with a fifo cache of cache_size entries.
+     * 3 is no reuse at all, around 0.5 to 0.7 is typical of an optimized closed mesh.
+     */
+    static float GetACMR(const std::vector<std::uint32_t> &indices, size_t vertex_count, size_t cache_size = kCacheSize);
+
+    /**
+     * @brief quantizes positions and uvs to 16 bit steps of the given scale above the given minimum, and normals to
+     * 2 x 8 bit octahedral coordinates. Model::Dequantize is the inverse.
+     */
+    static void Quantize(std::span<const MeshVertex> vertices, const Vector3f &position_min, const Vector3f &position_scale,
+                         const Vector2f &uv_min, const Vector2f &uv_scale, std::vector<QuantizedVertex> &quantized);
+};
+
+#endif //MESH_OPTIMIZER_H
@@ -1,42 +1,162 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <span>
 #include <string>
 #include <vector>
+#include "asset_handle.h"
 #include "buffer.h"
 #include "maths/vector.h"
+#include "utility/mapped_file.h"
+
+/**
+ * @brief attribute and index arrays of a mesh as parsed from an obj file.
+ */
+struct MeshArrays {
+    std::vector<Vector3f> vertices;
+    std::vector<Vector2f> tex_coords;
+    std::vector<Vector3f> normals;
+    std::vector<int> vertex_indices;
+    std::vector<int> tex_coord_indices;
+    std::vector<int> normal_indices;
+};
+
+/**
+ * @brief interleaved vertex of a welded mesh, addressed by a single index buffer.
+ */
+struct MeshVertex {
+    Vector3f position;
+    Vector3f normal;
+    Vector2f uv;
+};
+
+/**
+ * @brief quantized vertex, 12 bytes instead of 32. positions are 16 bit fractions of the model bounds, uvs 16 bit
+ * fractions of the uv bounds and normals are octahedral encoded in 2 x 8 bits.
+ */
+struct QuantizedVertex {
+    std::uint16_t position[3];
+    std::uint16_t normal;
+    std::uint16_t uv[2];
+};
+
+/**
+ * @brief vertex storage of a model. QUANTIZED models keep QuantizedVertex arrays and 16 bit indices when the vertex
+ * count allows it, attributes are decoded when they are fetched.
+ */
+enum MeshFormat {
+    FULL_PRECISION = 0,
+    QUANTIZED = 1
+};
+
+/**
+ * @brief texture maps of a model, shaders declare the maps they sample as a mask of these bits.
+ */
+enum TextureSlot {
+    DIFFUSE_MAP = 1 << 0,
+    SPECULAR_MAP = 1 << 1,
+    NORMAL_MAP = 1 << 2,
+    NORMAL_MAP_TANGENT = 1 << 3,
+    ALL_TEXTURE_MAPS = DIFFUSE_MAP | SPECULAR_MAP | NORMAL_MAP | NORMAL_MAP_TANGENT
+};
 
 class Model {
 public:
     Model() = delete;
-    explicit Model(const std::string &filename);
-
-    [[nodiscard]] const ColorBuffer* diffuse_map() const { return diffuse_map_.get(); }
-    [[nodiscard]] const ColorBuffer* specular_map() const { return specular_map_.get(); }
-    [[nodiscard]] const ColorBuffer* normal_map() const { return normal_map_.get(); }
-    [[nodiscard]] const ColorBuffer* normal_map_tangent() const { return normal_map_tangent_.get(); }
-    [[nodiscard]] size_t vertices_size() const { return vertices_.size(); }
-    [[nodiscard]] size_t faces_size() const { return vertex_indices_.size() / 3; }
-    [[nodiscard]] Vector3f vertex(const size_t i) const { return vertices_[i]; }
-    [[nodiscard]] Vector3f vertex(const size_t face_index, const size_t vertex_index) const { return vertices_[vertex_indices_[face_index * 3 + vertex_index]]; }
-    [[nodiscard]] Vector2f uv(const size_t face_index, const size_t vertex_index) const { return tex_coords_[tex_coord_indices_[face_index * 3 + vertex_index]]; }
-    [[nodiscard]] Vector3f normal(const size_t face_index, const size_t vertex_index) const { return normals_[normal_indices_[face_index * 3 + vertex_index]]; }
+    explicit Model(const std::string &filename, MeshFormat format = FULL_PRECISION);
+
+    /**
+     * @brief starts loading the maps of a TextureSlot mask in the background and publishes the ones that finished since
+     * the last call, maps no shader asks for never touch the disk. thread safe and never waits for a load.
+     * a map is nullptr until it is published, and stays nullptr if its file is missing.
+     */
+    void RequireTextures(std::uint32_t slots) const;
+    // RequireTextures that returns once every map of the mask is published, for renders that cannot show placeholders
+    void WaitForTextures(std::uint32_t slots) const;
+
+    [[nodiscard]] const ColorBuffer* diffuse_map() const { return texture_maps_[0].load(std::memory_order_acquire); }
+    [[nodiscard]] const ColorBuffer* specular_map() const { return texture_maps_[1].load(std::memory_order_acquire); }
+    [[nodiscard]] const ColorBuffer* normal_map() const { return texture_maps_[2].load(std::memory_order_acquire); }
+    [[nodiscard]] const ColorBuffer* normal_map_tangent() const { return texture_maps_[3].load(std::memory_order_acquire); }
+    [[nodiscard]] const Vector3f& bounds_min() const { return bounds_min_; }
+    [[nodiscard]] const Vector3f& bounds_max() const { return bounds_max_; }
+    [[nodiscard]] MeshFormat format() const { return format_; }
+    [[nodiscard]] size_t vertices_size() const { return format_ == QUANTIZED ? quantized_vertices_.size() : vertices_.size(); }
+    [[nodiscard]] size_t faces_size() const { return (short_indices_.empty() ? indices_.size() : short_indices_.size()) / 3; }
+    [[nodiscard]] std::uint32_t index(const size_t face_index, const size_t vertex_index) const {
+        const size_t i = face_index * 3 + vertex_index;
+        return short_indices_.empty() ? indices_[i] : short_indices_[i];
+    }
+    [[nodiscard]] MeshVertex mesh_vertex(const size_t i) const { return format_ == QUANTIZED ? Dequantize(quantized_vertices_[i]) : vertices_[i]; }
+    [[nodiscard]] Vector3f vertex(const size_t i) const { return mesh_vertex(i).position; }
+    [[nodiscard]] Vector3f vertex(const size_t face_index, const size_t vertex_index) const { return mesh_vertex(index(face_index, vertex_index)).position; }
+    [[nodiscard]] Vector2f uv(const size_t face_index, const size_t vertex_index) const { return mesh_vertex(index(face_index, vertex_index)).uv; }
+    [[nodiscard]] Vector3f normal(const size_t face_index, const size_t vertex_index) const { return mesh_vertex(index(face_index, vertex_index)).normal; }
     [[nodiscard]] Vector3f normal(const Vector2f &uvf) const;
     [[nodiscard]] Vector3f normal_tangent(const Vector2f &uvf) const;
 
 private:
-    static std::unique_ptr<ColorBuffer> LoadTGAImage(const std::string &filename, const std::string &suffix);
-
-    std::vector<Vector3f> vertices_;
-    std::vector<Vector2f> tex_coords_;
-    std::vector<Vector3f> normals_;
-    std::vector<int> vertex_indices_;
-    std::vector<int> tex_coord_indices_;
-    std::vector<int> normal_indices_;
-    std::unique_ptr<ColorBuffer> diffuse_map_;
-    std::unique_ptr<ColorBuffer> specular_map_;
-    std::unique_ptr<ColorBuffer> normal_map_;
-    std::unique_ptr<ColorBuffer> normal_map_tangent_;
+    static AssetHandle<const ColorBuffer> LoadTGAImage(const std::string &filename, const std::string &suffix);
+    void PublishTextures(std::uint32_t slots, bool wait) const;
+
+    /**
+     * @brief binary cache next to the obj file (filename + ".meshcache"), rebuilt when the obj size or mtime changes.
+     * a valid cache is mapped and the arrays point straight into it.
+     */
+    bool LoadMeshCache(const std::string &filename);
+    void WriteMeshCache(const std::string &filename) const;
+
+    /**
+     * @brief replaces the full precision arrays with quantized ones.
+     */
+    void Quantize();
+
+    [[nodiscard]] MeshVertex Dequantize(const QuantizedVertex &quantized) const {
+        MeshVertex vertex;
+        for (size_t i = 0; i < 3; ++i) vertex.position[i] = bounds_min_[i] + static_cast<float>(quantized.position[i]) * position_scale_[i];
+        for (size_t i = 0; i < 2; ++i) vertex.uv[i] = uv_min_[i] + static_cast<float>(quantized.uv[i]) * uv_scale_[i];
+        // octahedral: the upper hemisphere maps to the inner diamond, the lower one is folded over the corners
+        float x = static_cast<float>(quantized.normal & 0xFF) / 127.5f - 1;
+        float y = static_cast<float>(quantized.normal >> 8) / 127.5f - 1;
+        const float z = 1 - std::abs(x) - std::abs(y);
+        if (z < 0) {
+            const float folded_x = (1 - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+            y = (1 - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+            x = folded_x;
+        }
+        vertex.normal = Vector3f{x, y, z}.Normalize();
+        return vertex;
+    }
+
+    // welded at load time, the arrays point either into the storage vectors or into the mapped cache file
+    std::span<const MeshVertex> vertices_;
+    std::span<const std::uint32_t> indices_;
+    Vector3f bounds_min_;
+    Vector3f bounds_max_;
+    std::vector<MeshVertex> vertex_storage_;
+    std::vector<std::uint32_t> index_storage_;
+    MeshFormat format_ = FULL_PRECISION;
+    std::vector<QuantizedVertex> quantized_vertices_;
+    std::vector<std::uint16_t> short_indices_;
+    Vector3f position_scale_;
+    Vector2f uv_min_;
+    Vector2f uv_scale_;
+    MappedFile cache_file_;
+    static constexpr size_t kTextureSlots = 4;
+
+    std::string filename_;
+    // indexed by TextureSlot bit. shaders read the published pointers while later maps are still being published
+    mutable std::array<AssetHandle<const ColorBuffer>, kTextureSlots> texture_loads_;
+    mutable std::array<std::shared_ptr<const ColorBuffer>, kTextureSlots> texture_storage_;
+    mutable std::array<std::atomic<const ColorBuffer*>, kTextureSlots> texture_maps_ {};
+    mutable std::uint32_t requested_textures_ = 0;  // guarded by texture_mutex_
+    mutable std::atomic<std::uint32_t> published_textures_ {0};
+    mutable std::mutex texture_mutex_;
 };
 
 #endif //MODEL_H
@@ -1,6 +1,8 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include <limits>
+#include <span>
 #include <scene.h>
 
 #include "color.h"
@@ -8,15 +10,83 @@
 #include "component-gameobject.h"
 #include "ishader.h"
 #include "maths/maths.h"
+#include "utility/frame_arena.h"
 
 class Renderer {
 public:
+    static constexpr size_t kTileSize = TileClearState::kTileSize; // render tiles match the lazily cleared buffer tiles
+    static constexpr float kMaxHeat = 8;
+    static constexpr float kSamplePadding = 0.5f; // multisampled pixels cover samples up to half a pixel away
+
     static void DrawLine(Vector2f p0, Vector2f p1, const Color &color, const ColorBuffer &buffer);
-    static void DrawModel(const Model &model, const IShader &shader, const FrameBuffer &frame_buffer, const GBuffer &g_buffer, const RenderPath &
-                          render_path);
+    static void DrawModel(const DrawState &state, const FrameBuffer &frame_buffer, const GBuffer &g_buffer, const RenderPath &render_path);
+
+    /**
+     * @brief draws a list of draw states.
+     * vertex processing and binning run in parallel over the draws, rasterization runs in parallel over screen tiles,
+     * and every tile replays its triangles in submission order so the result does not depend on scheduling.
+     * transient data (shaded triangles, tile bins) comes from the arena when one is given, it must not be reset before
+     * Submit returns.
+     */
+    static void Submit(std::span<const DrawState> draws, const FrameBuffer &frame_buffer, const GBuffer &g_buffer, const RenderPath &render_path,
+                       FrameArena *arena = nullptr);
+
+    /**
+     * @brief replaces the color buffer with a false-colour heatmap of the fragment shader invocations per pixel.
+     * black is never drawn, blue to red is 1 to kMaxHeat or more fragments.
+     */
+    static OverdrawStats DrawOverdrawHeatmap(const GBuffer &g_buffer, const FrameBuffer &frame_buffer, FrameArena *arena = nullptr);
+
+    /**
+     * @brief averages the samples of a multisampled frame into its color buffer and keeps the nearest sample depth.
+     * does nothing without multisampling, it runs once after the last Submit of a frame.
+     */
+    static void ResolveMultisample(const FrameBuffer &frame_buffer);
+
+    /**
+     * @brief stretches the rendered region of a scaled frame over its whole color buffer with bilinear filtering.
+     * it runs last, after lighting and the debug views, and does nothing for frames rendered at full size.
+     */
+    static void Upscale(const FrameBuffer &frame_buffer, FrameArena *arena = nullptr);
 private:
-    static void RasterizeTriangle(const std::array<Vertex, 3> &triangle, const IShader &shader, const FrameBuffer &frame_buffer, const GBuffer &g_buffer, const
-                                  RenderPath &render_path);
+    friend struct RendererBench;
+
+    /**
+     * @brief shaded triangles of a range of faces of some instances of one draw, binned by screen tile.
+     * instances are expanded one after the other, so a near instance is rasterized before a far one in every tile.
+     */
+    struct TriangleBatch {
+        explicit TriangleBatch(FrameArena *arena = nullptr)
+            : triangles(ArenaAllocator<std::array<Vertex, 3>>(arena)), bin_offsets(ArenaAllocator<std::uint32_t>(arena)),
+              bin_triangles(ArenaAllocator<std::uint32_t>(arena)) { }
+
+        const DrawState *state = nullptr;
+        std::span<const std::uint32_t> instances;   // indices into state->instances, nearest first
+        size_t face_begin = 0;
+        size_t face_end = 0;
+        ArenaVector<std::array<Vertex, 3>> triangles;
+        ArenaVector<std::uint32_t> bin_offsets;     // tile t owns bin_triangles[bin_offsets[t], bin_offsets[t + 1])
+        ArenaVector<std::uint32_t> bin_triangles;
+    };
+
+    /**
+     * @brief entry of the fifo post-transform cache, shaded vertices are reused while their index stays in it.
+     */
+    struct VertexCacheEntry {
+        std::uint32_t index = std::numeric_limits<std::uint32_t>::max();
+        Vertex vertex{};
+    };
+
+    static void ProcessVertices(TriangleBatch &batch, size_t width, size_t height, float padding = 0);
+    static void RasterizeTriangle(const std::array<Vertex, 3> &triangle, const DrawState &state, const FrameBuffer &frame_buffer, const GBuffer &g_buffer, const
+                                  RenderPath &render_path, const Vector2s &tile_min, const Vector2s &tile_max);
+    /**
+     * @brief coverage and depth are tested per sample, the fragment shader runs once for the samples that passed.
+     */
+    static void RasterizeTriangleMultisample(const std::array<Vertex, 3> &triangle, const DrawState &state, const FrameBuffer &frame_buffer,
+                                             const GBuffer &g_buffer, const RenderPath &render_path, const Vector2s &tile_min, const Vector2s &tile_max);
+    static bool GetScreenBounds(const std::array<Vertex, 3> &triangle, size_t width, size_t height, Vector2s &box_min, Vector2s &box_max,
+                                float padding = 0);
     static Vector3f GetBarycentric2d(const std::array<Vertex, 3> &triangle, const Vector2f &p);
 };
 
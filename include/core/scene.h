@@ -1,7 +1,8 @@
 #ifndef SCENE_H
 #define SCENE_H
 
-#include "platform/win32/win32_wnd.h"
+#include "platform/iwindow.h"
+#include "command_buffer.h"
 #include "component-gameobject.h"
 #include "ishader.h"
 
@@ -10,6 +11,11 @@ enum RenderPath {
     DEFERRED = 1
 };
 
+enum DebugView {
+    NONE = 0,
+    OVERDRAW = 1
+};
+
 struct Scene {
     explicit Scene(
         const std::shared_ptr<CameraObject> &camera = nullptr,
@@ -23,17 +29,38 @@ struct Scene {
     std::vector<Light> lights{};
     int current_shader_index = 0;
     bool auto_rotate = true;
+    bool capture_frames = false;    // read by the render loop, see FrameCapture
     RenderPath render_path = FORWARD;
+    int msaa_samples = 1;           // samples per pixel, 1, 2, 4 or 8
+    float resolution_scale = 1.0f;  // fraction of the frame buffer size rendered, the rest is upscaled
+    bool dynamic_resolution = false; // read by the render loop, see ResolutionController
+    DebugView debug_view = NONE;
     std::shared_ptr<GBuffer> g_buffer;
 
     void Render() const;
+    void UpdateTransforms() const;
+    // static objects are only re-recorded after this call (or a shader switch)
+    void InvalidateStaticCommands() const { static_commands_dirty_ = true; }
+
+    // statistics of the last frame rendered with the overdraw view
+    [[nodiscard]] const OverdrawStats& overdraw_stats() const { return overdraw_stats_; }
 
     [[nodiscard]] bool CanRender() const { return camera_obj != nullptr && frame_buffer != nullptr && !mesh_objs.empty() && shader_list[current_shader_index] != nullptr; }
+
+private:
+    mutable CommandBuffer static_commands_;
+    mutable CommandBuffer dynamic_commands_;
+    mutable std::shared_ptr<const IShader> static_commands_shader_;
+    mutable bool static_commands_dirty_ = true;
+    mutable OverdrawStats overdraw_stats_;
+    mutable std::shared_ptr<FrameState> frame_state_;
+    // transient data of the frame being rendered, released when the next frame starts
+    mutable FrameArena frame_arena_;
 };
 
 struct Callbacks {
-    static void OnKeyPressed(Win32Wnd* windows, KeyCode keycode);
-    static void OnMousePressed(const Win32Wnd* windows, MouseCode mousecode);
+    static void OnKeyPressed(IWindow* windows, KeyCode keycode);
+    static void OnMousePressed(const IWindow* windows, MouseCode mousecode);
 };
 
 #endif //SCENE_H
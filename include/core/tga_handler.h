@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 #include "buffer.h"
 
 #define RLE_MAX_CHUNK_LENGTH 128
@@ -34,11 +35,23 @@ class TGAHandler {
 public:
     TGAHandler() = delete;
 
-    static std::unique_ptr<ColorBuffer> ReadTGAFile(const std::string &filename);
+    /**
+     * @brief decodes a .tga file, pad_rgb stores 24 bit images as 32 bit so every texel is one aligned 4 byte load.
+     * uncompressed files that need no padding are not copied, the returned buffer is a read-only view of the mapped file.
+     */
+    static std::unique_ptr<ColorBuffer> ReadTGAFile(const std::string &filename, bool pad_rgb = false);
+    /**
+     * @brief encodes and writes a .tga file with a single write of the data, uncompressed data is written straight from
+     * the given pixels and rle data is encoded in parallel row bands.
+     */
     static bool WriteTGAFile(const std::string &filename, int width, int height, std::uint8_t bpp, const std::uint8_t *data, bool v_flip = false, bool rle = true);
+    // views with packed rows are written without a copy, whichever way up they are
+    static bool WriteTGAFile(const std::string &filename, const ColorBuffer &buffer, bool v_flip = false, bool rle = true);
 private:
-    static bool LoadRLE(std::ifstream &in, ColorBuffer &buffer);
-    static bool UnloadRLE(std::ofstream &out, int width, int height, std::uint8_t bpp, const std::uint8_t *data);
+    static constexpr size_t kEncodeBandPixels = 1 << 16; // pixels per encode task, rounded to whole rows
+
+    static void EncodeRLE(size_t width, size_t height, std::uint8_t bpp, const std::uint8_t *data, std::vector<std::uint8_t> &out);
+    static void EncodeRLEBand(const std::uint8_t *data, size_t begin, size_t end, std::uint8_t bpp, std::vector<std::uint8_t> &out);
 };
 
 #endif //TGA_HANDLER_H
@@ -0,0 +1,58 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+/**
+ * @brief debug counter of heap allocations made while a frame renders, enabled by defining HMXS_COUNT_ALLOCATIONS
+ * (cmake option HMXS_ENABLE_ALLOCATION_COUNTER), which replaces the global operator new.
+ * every thread is counted while a frame scope is open, malloc calls that bypass operator new are not seen.
+ * without it the macro below expands to nothing.
+ *
+ * ALLOCATION_FRAME_SCOPE()     counts the allocations until the end of the enclosing scope, a frame that allocates
+ *                              after the warm-up frames is logged as a warning
+ */
+
+#ifdef HMXS_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdint>
+
+class AllocationCounter {
+public:
+    static constexpr std::uint64_t kWarmupFrames = 2; // first frames grow the arenas and pools
+
+    AllocationCounter() = delete;
+
+    static void OnAllocation() {
+        if (open_scopes_.load(std::memory_order_relaxed) > 0) allocations_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] static std::uint64_t last_frame() { return last_frame_.load(std::memory_order_relaxed); }
+
+    class FrameScope {
+    public:
+        FrameScope();
+        ~FrameScope();
+
+        FrameScope(const FrameScope&) = delete;
+        FrameScope& operator=(const FrameScope&) = delete;
+
+    private:
+        std::uint64_t begin_;
+    };
+
+private:
+    static inline std::atomic<int> open_scopes_ {0};
+    static inline std::atomic<std::uint64_t> allocations_ {0};
+    static inline std::atomic<std::uint64_t> last_frame_ {0};
+    static inline std::atomic<std::uint64_t> frame_count_ {0};
+};
+
+#define ALLOCATION_FRAME_SCOPE() const AllocationCounter::FrameScope allocation_frame_scope
+
+#else
+
+#define ALLOCATION_FRAME_SCOPE()
+
+#endif
+
+#endif //ALLOCATION_COUNTER_H
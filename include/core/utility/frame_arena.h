@@ -0,0 +1,168 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief linear allocator for data that lives for one frame, with one block per thread so threads never contend.
+ * memory is only released all at once by Reset. a thread that runs out of block space continues in a new block, and
+ * Reset merges its blocks into a single one, so a steady frame loop stops allocating after its first frame.
+ */
+class FrameArena {
+public:
+    static constexpr size_t kInitialBlockSize = 64 * 1024;
+
+    FrameArena() : id_(next_id_.fetch_add(1) + 1) { }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(const size_t bytes, const size_t alignment = alignof(std::max_align_t)) {
+        return GetThreadArena().Allocate(bytes, alignment);
+    }
+
+    /**
+     * @brief releases everything allocated since the previous reset.
+     * nothing allocated from the arena may be used afterwards, and no thread may allocate from it meanwhile.
+     */
+    void Reset() {
+        std::lock_guard lock(mutex_);
+        for (const auto &arena : threads_) arena->Reset();
+    }
+
+    // bytes reserved over all threads
+    [[nodiscard]] size_t capacity() const {
+        std::lock_guard lock(mutex_);
+        size_t bytes = 0;
+        for (const auto &arena : threads_) bytes += arena->capacity();
+        return bytes;
+    }
+
+private:
+    class ThreadArena {
+    public:
+        explicit ThreadArena(const std::thread::id thread) : thread_(thread) { }
+
+        void* Allocate(const size_t bytes, const size_t alignment) {
+            auto address = reinterpret_cast<std::uintptr_t>(block_.get()) + used_;
+            std::uintptr_t aligned = (address + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+            if (block_ == nullptr || aligned + bytes > reinterpret_cast<std::uintptr_t>(block_.get()) + block_size_) {
+                // the full block stays alive until the reset, earlier allocations still point into it
+                if (block_ != nullptr) {
+                    retired_bytes_ += block_size_;
+                    retired_.push_back(std::move(block_));
+                }
+                block_size_ = std::max(std::max(kInitialBlockSize, block_size_ * 2), bytes + alignment);
+                block_ = std::make_unique_for_overwrite<std::byte[]>(block_size_);
+                used_ = 0;
+                address = reinterpret_cast<std::uintptr_t>(block_.get());
+                aligned = (address + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+            }
+            used_ = aligned + bytes - reinterpret_cast<std::uintptr_t>(block_.get());
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        void Reset() {
+            if (!retired_.empty()) {
+                block_size_ += retired_bytes_;
+                block_ = std::make_unique_for_overwrite<std::byte[]>(block_size_);
+                retired_.clear();
+                retired_bytes_ = 0;
+            }
+            used_ = 0;
+        }
+
+        [[nodiscard]] std::thread::id thread() const { return thread_; }
+        [[nodiscard]] size_t capacity() const { return block_size_ + retired_bytes_; }
+
+    private:
+        std::thread::id thread_;
+        std::unique_ptr<std::byte[]> block_;
+        size_t block_size_ = 0;
+        size_t used_ = 0;
+        std::vector<std::unique_ptr<std::byte[]>> retired_;
+        size_t retired_bytes_ = 0;
+    };
+
+    ThreadArena& GetThreadArena() {
+        // the last few arenas a thread used, pool workers serve several arenas without taking the lock every time.
+        // ids are never reused, so entries of destroyed arenas never match
+        struct CacheEntry {
+            std::uint64_t arena_id = 0;
+            ThreadArena *arena = nullptr;
+        };
+        thread_local std::array<CacheEntry, 4> cache{};
+        thread_local size_t cache_next = 0;
+        for (const auto &entry : cache)
+            if (entry.arena_id == id_) return *entry.arena;
+
+        ThreadArena *arena = nullptr;
+        {
+            std::lock_guard lock(mutex_);
+            const auto it = std::find_if(threads_.begin(), threads_.end(), [](const auto &a) { return a->thread() == std::this_thread::get_id(); });
+            if (it != threads_.end()) {
+                arena = it->get();
+            } else {
+                threads_.push_back(std::make_unique<ThreadArena>(std::this_thread::get_id()));
+                arena = threads_.back().get();
+            }
+        }
+        cache[cache_next++ % cache.size()] = {id_, arena};
+        return *arena;
+    }
+
+    static inline std::atomic<std::uint64_t> next_id_ {0};
+
+    std::uint64_t id_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadArena>> threads_;
+};
+
+/**
+ * @brief standard allocator over a frame arena, deallocation is a no-op. without an arena it uses the heap, so
+ * containers of this type also work outside of a frame.
+ */
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() = default;
+    explicit ArenaAllocator(FrameArena *arena) : arena_(arena) { }
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) { }
+
+    T* allocate(const size_t n) {
+        if (arena_ == nullptr) return std::allocator<T>().allocate(n);
+        return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, const size_t n) {
+        if (arena_ == nullptr) std::allocator<T>().deallocate(p, n);
+    }
+
+    [[nodiscard]] FrameArena* arena() const { return arena_; }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena_ == other.arena(); }
+
+private:
+    FrameArena *arena_ = nullptr;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif //FRAME_ARENA_H
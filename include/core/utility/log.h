@@ -1,18 +1,45 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <string>
 #include <mutex>
 #include <sstream>
+#include <thread>
 
-#define LOG_ERROR(message) Log::Instance().LogMessage(Log::Level::LOG_ERROR, message)
-#define LOG_WARNING(message) Log::Instance().LogMessage(Log::Level::LOG_WARNING, message)
-#define LOG_INFO(message) Log::Instance().LogMessage(Log::Level::LOG_INFO, message)
-#define LOG_DEBUG(message) Log::Instance().LogMessage(Log::Level::LOG_DEBUG, message)
+// compile-time minimum level, 0 error, 1 warning, 2 info, 3 debug (cmake cache variable HMXS_LOG_LEVEL). calls above
+// it are removed entirely
+#ifndef HMXS_LOG_LEVEL
+#define HMXS_LOG_LEVEL 3
+#endif
 
+// the message expression is only evaluated when the level passes both the compile-time and the runtime filter,
+// a filtered call costs one relaxed load and never builds its string
+#define LOG_MESSAGE_IMPL(level, message) \
+    do { \
+        if constexpr (static_cast<int>(level) <= HMXS_LOG_LEVEL) { \
+            if (Log &log_instance = Log::Instance(); log_instance.IsEnabled(level)) log_instance.LogMessage(level, message); \
+        } \
+    } while (0)
+
+#define LOG_ERROR(message) LOG_MESSAGE_IMPL(Log::Level::LOG_ERROR, message)
+#define LOG_WARNING(message) LOG_MESSAGE_IMPL(Log::Level::LOG_WARNING, message)
+#define LOG_INFO(message) LOG_MESSAGE_IMPL(Log::Level::LOG_INFO, message)
+#define LOG_DEBUG(message) LOG_MESSAGE_IMPL(Log::Level::LOG_DEBUG, message)
+
+/**
+ * @brief asynchronous logger.
+ * callers build the message of an enabled level themselves and move it into a bounded lock-free multi-producer ring
+ * buffer. the timestamp, the line prefix and the writes to std::cout and the log file are left to a background thread.
+ * when the ring is full the message is dropped and counted instead of blocking the caller.
+ * the writer sleeps while the ring is empty, a producer only wakes it when it has announced that it sleeps.
+ */
 class Log {
 public:
     enum class Level {
@@ -22,18 +49,24 @@ public:
         LOG_DEBUG
     };
 
+    static constexpr size_t kCapacity = 8192; // power of two
+
     static Log& Instance() {
         static Log instance;
         return instance;
     }
 
     void SetLogLevel(const Level level) {
-        std::lock_guard lock(mutex_);
         log_level_ = level;
     }
 
+    [[nodiscard]] bool IsEnabled(const Level level) const {
+        return level <= log_level_.load(std::memory_order_relaxed);
+    }
+
     void SetLogFile(const std::string& filename, const std::ios_base::openmode mode = std::ios::out | std::ios::app) {
-        std::lock_guard lock(mutex_);
+        Flush();
+        std::lock_guard lock(file_mutex_);
         if (log_file_.is_open()) {
             log_file_.close();
         }
@@ -43,41 +76,139 @@ public:
         }
     }
 
-    void LogMessage(const Level level, const std::string& message) {
-        if (level > log_level_) return;
+    // the LOG_* macros have checked the level already, the check here only covers direct calls
+    void LogMessage(const Level level, std::string message) {
+        if (!IsEnabled(level)) return;
 
-        std::string log_message;
-        {
-            const std::string timestamp = GetCurrentTimestamp();
-            const std::string level_str = LevelToString(level);
-            std::ostringstream oss;
-            oss << "[" << timestamp << "] [" << level_str << "] " << message << "\n";
-            log_message = oss.str();
-        }
-        {
-            std::lock_guard lock(mutex_);
-            std::cout << log_message;
-            if (log_file_.is_open()) {
-                log_file_ << log_message;
+        // claim a slot, a slot is free when its sequence equals the position (bounded mpmc queue by D. Vyukov)
+        size_t position = enqueue_position_.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[position & (kCapacity - 1)];
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (diff == 0) {
+                if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = enqueue_position_.load(std::memory_order_relaxed);
             }
         }
+        slot->level = level;
+        slot->time = std::chrono::system_clock::now();
+        slot->message = std::move(message);
+        slot->sequence.store(position + 1, std::memory_order_release);
+        // pairs with the fence in WriterLoop, either the writer sees this message or this call sees the writer asleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed)) WakeWriter();
+    }
+
+    /**
+     * @brief waits until every message logged before the call has been written.
+     */
+    void Flush() {
+        const size_t target = enqueue_position_.load(std::memory_order_acquire);
+        std::unique_lock lock(flush_mutex_);
+        // messages up to target have woken the writer when they were published
+        flushed_.wait(lock, [&] { return written_.load(std::memory_order_acquire) >= target; });
     }
 
     Log(const Log&) = delete;
     Log& operator=(const Log&) = delete;
 
 private:
-    Log() : log_level_(Level::LOG_INFO) {};
-
-    static std::string GetCurrentTimestamp() {
-        const auto now = std::chrono::system_clock::now();
-        const auto now_c = std::chrono::system_clock::to_time_t(now);
-        const auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-        std::tm now_tm{};
-        localtime_s(&now_tm, &now_c);
+    struct Slot {
+        std::atomic<size_t> sequence {0};
+        Level level = Level::LOG_INFO;
+        std::chrono::system_clock::time_point time;
+        std::string message;
+    };
+
+    Log() : log_level_(Level::LOG_INFO) {
+        for (size_t i = 0; i < kCapacity; ++i) slots_[i].sequence.store(i, std::memory_order_relaxed);
+        writer_ = std::thread([this] { WriterLoop(); });
+    }
+
+    ~Log() {
+        stop_.store(true);
+        WakeWriter();
+        writer_.join();
+    }
+
+    void WakeWriter() {
+        if (sleeping_.exchange(false)) sleeping_.notify_one();
+    }
+
+    [[nodiscard]] bool HasPending() const {
+        const Slot &slot = slots_[dequeue_position_ & (kCapacity - 1)];
+        return slot.sequence.load(std::memory_order_relaxed) == dequeue_position_ + 1 || dropped_.load(std::memory_order_relaxed) > 0;
+    }
+
+    void WriterLoop() {
+        while (true) {
+            if (Drain()) {
+                std::lock_guard lock(flush_mutex_);
+                flushed_.notify_all();
+                continue;
+            }
+            if (stop_.load()) return;
+            // blocks until a producer, a flush or the destructor wakes it, the checks after the fence catch a message
+            // that was published before the producer could see the flag
+            sleeping_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!HasPending() && !stop_.load()) sleeping_.wait(true);
+            sleeping_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // writes everything in the ring, returns whether there was anything
+    bool Drain() {
+        std::string output;
+        size_t count = 0;
+        while (true) {
+            Slot &slot = slots_[dequeue_position_ & (kCapacity - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != dequeue_position_ + 1) break;
+            Format(output, slot.level, slot.time, slot.message);
+            slot.message.clear();
+            slot.sequence.store(dequeue_position_ + kCapacity, std::memory_order_release);
+            dequeue_position_++;
+            count++;
+        }
+        if (const size_t dropped = dropped_.exchange(0, std::memory_order_relaxed); dropped > 0) {
+            Format(output, Level::LOG_WARNING, std::chrono::system_clock::now(), "Log - ring buffer full, " + std::to_string(dropped) + " message(s) dropped");
+        }
+        if (output.empty()) return false;
+        {
+            std::lock_guard lock(file_mutex_);
+            std::cout << output << std::flush;
+            if (log_file_.is_open()) {
+                log_file_ << output << std::flush;
+            }
+        }
+        written_.fetch_add(count, std::memory_order_release);
+        return true;
+    }
+
+    static void Format(std::string &output, const Level level, const std::chrono::system_clock::time_point time, const std::string &message) {
         std::ostringstream oss;
-        oss << std::put_time(&now_tm, "%Y-%m-%d %H:%M:%S");
-        oss << '.' << std::setfill('0') << std::setw(3) << now_ms.count();
+        oss << "[" << GetTimestamp(time) << "] [" << LevelToString(level) << "] " << message << "\n";
+        output += oss.str();
+    }
+
+    static std::string GetTimestamp(const std::chrono::system_clock::time_point time) {
+        const auto time_c = std::chrono::system_clock::to_time_t(time);
+        const auto time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()) % 1000;
+        std::tm time_tm{};
+#ifdef _WIN32
+        localtime_s(&time_tm, &time_c);
+#else
+        localtime_r(&time_c, &time_tm);
+#endif
+        std::ostringstream oss;
+        oss << std::put_time(&time_tm, "%Y-%m-%d %H:%M:%S");
+        oss << '.' << std::setfill('0') << std::setw(3) << time_ms.count();
         return oss.str();
     }
 
@@ -91,9 +222,20 @@ private:
         }
     }
 
-    Level log_level_;
+    std::atomic<Level> log_level_;
+    std::array<Slot, kCapacity> slots_;
+    std::atomic<size_t> enqueue_position_ {0};
+    size_t dequeue_position_ = 0;           // writer thread only
+    std::atomic<size_t> written_ {0};
+    std::atomic<size_t> dropped_ {0};
+
     std::ofstream log_file_;
-    std::mutex mutex_;
+    std::mutex file_mutex_;
+    std::mutex flush_mutex_;
+    std::condition_variable flushed_;
+    std::atomic<bool> sleeping_ {false};
+    std::atomic<bool> stop_ {false};
+    std::thread writer_;
 };
 
 #endif //LOG_H
@@ -0,0 +1,112 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief read-only memory mapping of a whole file, the mapping lives as long as the object.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string &filename) {
+#ifdef _WIN32
+        file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) { Close(); return; }
+        size_ = static_cast<size_t>(size.QuadPart);
+        is_open_ = true;
+        if (size_ == 0) return;
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr) { Close(); return; }
+        data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr) Close();
+#else
+        const int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st {};
+        if (fstat(fd, &st) != 0) { close(fd); return; }
+        size_ = static_cast<size_t>(st.st_size);
+        is_open_ = true;
+        if (size_ > 0) {
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                size_ = 0;
+                is_open_ = false;
+            } else {
+                data_ = static_cast<const char*>(data);
+                madvise(data, size_, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd); // the mapping keeps the file referenced
+#endif
+    }
+
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile &&other) noexcept {
+        if (this == &other) return *this;
+        Close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        is_open_ = std::exchange(other.is_open_, false);
+#ifdef _WIN32
+        file_ = std::exchange(other.file_, INVALID_HANDLE_VALUE);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+        return *this;
+    }
+
+    [[nodiscard]] bool is_open() const { return is_open_; }
+    [[nodiscard]] const char* data() const { return data_; }
+    [[nodiscard]] size_t size() const { return size_; }
+
+private:
+    void Close() {
+#ifdef _WIN32
+        if (data_ != nullptr) UnmapViewOfFile(data_);
+        if (mapping_ != nullptr) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        is_open_ = false;
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool is_open_ = false;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+#endif //MAPPED_FILE_H
@@ -0,0 +1,288 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/**
+ * @brief per-stage cpu profiler, enabled by defining HMXS_PROFILE (cmake option HMXS_ENABLE_PROFILER).
+ * without it every macro below expands to nothing and its arguments are never evaluated.
+ *
+ * PROFILE_SCOPE(stage)             times the enclosing scope and records a trace event
+ * PROFILE_SCOPE_ACCUMULATE(stage)  times the enclosing scope without a trace event, for hot per-fragment scopes
+ * PROFILE_COUNT(counter, n)        adds n to a counter
+ * PROFILE_FRAME_MARK()             closes the current frame, its totals show up in PROFILE_FRAME_SUMMARY()
+ * PROFILE_WRITE_TRACE(filename)    writes the recorded events as chrome trace_event json (chrome://tracing, perfetto)
+ */
+
+#ifdef HMXS_PROFILE
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HMXS_PROFILE_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HMXS_PROFILE_RDTSC
+#endif
+
+enum class ProfileStage {
+    VertexShading,
+    PrimitiveAssembly,
+    Rasterization,
+    FragmentShading,
+    DeferredResolve,
+    Clear,
+    ClearResolve,           // fills the tiles a frame left untouched before it is presented
+    Present,
+    UiText,
+    Capture,
+    CaptureWrite,
+    MultisampleResolve,
+    Upscale,
+    Count
+};
+
+enum class ProfileCounter {
+    TrianglesSubmitted,
+    TrianglesCulled,
+    TrianglesBinned,        // bounding box touches the screen, the rasterizer may still find no covered pixel
+    FragmentsShaded,
+    DepthPass,
+    DepthFail,
+    Count
+};
+
+class Profiler {
+public:
+    static constexpr size_t kStageCount = static_cast<size_t>(ProfileStage::Count);
+    static constexpr size_t kCounterCount = static_cast<size_t>(ProfileCounter::Count);
+    static constexpr size_t kEventsPerThread = 1 << 16;    // ring buffer size, older events are overwritten
+    static constexpr size_t kFrameHistory = 1024;
+
+    struct Event {
+        ProfileStage stage;
+        std::uint64_t begin;
+        std::uint64_t end;
+    };
+
+    /**
+     * @brief data of one thread, only the owning thread writes to it.
+     * values are single-writer atomics so other threads can read them at any time without locking.
+     */
+    struct ThreadData {
+        std::array<std::atomic<std::uint64_t>, kStageCount> stage_ticks{};
+        std::array<std::atomic<std::uint64_t>, kCounterCount> counters{};
+        std::vector<Event> events = std::vector<Event>(kEventsPerThread);
+        std::atomic<std::uint64_t> event_count {0};
+        size_t thread_index = 0;
+
+        static void Add(std::atomic<std::uint64_t> &value, const std::uint64_t n) {
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    };
+
+    struct FrameStats {
+        std::uint64_t frame_index = 0;
+        std::uint64_t end_ticks = 0;
+        std::array<double, kStageCount> stage_ms{};
+        std::array<std::uint64_t, kCounterCount> counters{};
+    };
+
+    static Profiler& Instance() {
+        static Profiler instance;
+        return instance;
+    }
+
+    static std::uint64_t Now() {
+#ifdef HMXS_PROFILE_RDTSC
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static const char* StageName(const ProfileStage stage) {
+        static constexpr const char* kNames[] = {
+            "VertexShading", "PrimitiveAssembly", "Rasterization", "FragmentShading", "DeferredResolve", "Clear", "ClearResolve", "Present",
+            "UiText", "Capture", "CaptureWrite", "MultisampleResolve", "Upscale"
+        };
+        return kNames[static_cast<size_t>(stage)];
+    }
+
+    static const char* CounterName(const ProfileCounter counter) {
+        static constexpr const char* kNames[] = {
+            "TrianglesSubmitted", "TrianglesCulled", "TrianglesBinned", "FragmentsShaded", "DepthPass", "DepthFail"
+        };
+        return kNames[static_cast<size_t>(counter)];
+    }
+
+    ThreadData& GetThreadData() {
+        thread_local ThreadData* data = RegisterThread();
+        return *data;
+    }
+
+    void Record(const ProfileStage stage, const std::uint64_t begin, const std::uint64_t end, const bool trace) {
+        ThreadData &data = GetThreadData();
+        data.Add(data.stage_ticks[static_cast<size_t>(stage)], end - begin);
+        if (!trace) return;
+        const std::uint64_t count = data.event_count.load(std::memory_order_relaxed);
+        data.events[count % kEventsPerThread] = {stage, begin, end};
+        data.event_count.store(count + 1, std::memory_order_release);
+    }
+
+    void Count(const ProfileCounter counter, const std::uint64_t n) {
+        ThreadData &data = GetThreadData();
+        data.Add(data.counters[static_cast<size_t>(counter)], n);
+    }
+
+    /**
+     * @brief closes a frame, the frame totals are the difference of all thread totals since the previous mark.
+     * stages are summed over threads, so they are cpu time and nested stages (fragment shading) are also part of their parent.
+     */
+    void MarkFrame() {
+        std::lock_guard lock(mutex_);
+        FrameStats stats;
+        stats.frame_index = frame_count_++;
+        stats.end_ticks = Now();
+        std::array<std::uint64_t, kStageCount> stage_totals{};
+        std::array<std::uint64_t, kCounterCount> counter_totals{};
+        for (const auto &data : threads_) {
+            for (size_t i = 0; i < kStageCount; ++i) stage_totals[i] += data->stage_ticks[i].load(std::memory_order_relaxed);
+            for (size_t i = 0; i < kCounterCount; ++i) counter_totals[i] += data->counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < kStageCount; ++i) stats.stage_ms[i] = static_cast<double>(stage_totals[i] - last_stage_totals_[i]) / ticks_per_ms_;
+        for (size_t i = 0; i < kCounterCount; ++i) stats.counters[i] = counter_totals[i] - last_counter_totals_[i];
+        last_stage_totals_ = stage_totals;
+        last_counter_totals_ = counter_totals;
+        history_.push_back(stats);
+        if (history_.size() > kFrameHistory) history_.pop_front();
+    }
+
+    [[nodiscard]] std::string GetFrameSummary() {
+        std::lock_guard lock(mutex_);
+        if (history_.empty()) return {};
+        const FrameStats &stats = history_.back();
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2) << "Profile (cpu ms, frame " << stats.frame_index << "):\n";
+        for (size_t i = 0; i < kStageCount; ++i)
+            oss << "  " << std::left << std::setw(18) << StageName(static_cast<ProfileStage>(i)) << stats.stage_ms[i] << "\n";
+        for (size_t i = 0; i < kCounterCount; ++i)
+            oss << "  " << std::left << std::setw(18) << CounterName(static_cast<ProfileCounter>(i)) << stats.counters[i] << "\n";
+        return oss.str();
+    }
+
+    /**
+     * @brief writes the events still in the ring buffers and the per-frame counters as chrome trace_event json.
+     * call it while the renderer is idle, events written during the export may be torn.
+     */
+    bool WriteChromeTrace(const std::string &filename) {
+        std::ofstream out(filename);
+        if (!out.is_open()) return false;
+        std::lock_guard lock(mutex_);
+        const double ticks_per_us = ticks_per_ms_ / 1000.0;
+        out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (const auto &data : threads_) {
+            out << (first ? "" : ",\n") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << data->thread_index
+                << R"(,"args":{"name":"thread )" << data->thread_index << "\"}}";
+            first = false;
+            const std::uint64_t count = data->event_count.load(std::memory_order_acquire);
+            for (std::uint64_t i = count > kEventsPerThread ? count - kEventsPerThread : 0; i < count; ++i) {
+                const Event &event = data->events[i % kEventsPerThread];
+                out << ",\n" << R"({"name":")" << StageName(event.stage) << R"(","ph":"X","pid":1,"tid":)" << data->thread_index
+                    << ",\"ts\":" << static_cast<double>(event.begin - start_ticks_) / ticks_per_us
+                    << ",\"dur\":" << static_cast<double>(event.end - event.begin) / ticks_per_us << "}";
+            }
+        }
+        for (const auto &stats : history_) {
+            out << (first ? "" : ",\n") << R"({"name":"Frame","ph":"C","pid":1,"tid":0,"ts":)"
+                << static_cast<double>(stats.end_ticks - start_ticks_) / ticks_per_us << ",\"args\":{";
+            first = false;
+            for (size_t i = 0; i < kCounterCount; ++i)
+                out << (i ? "," : "") << "\"" << CounterName(static_cast<ProfileCounter>(i)) << "\":" << stats.counters[i];
+            out << "}}";
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+private:
+    Profiler() : start_ticks_(Now()) {
+#ifdef HMXS_PROFILE_RDTSC
+        // the tick rate of rdtsc is constant on current cpus but unknown, calibrate it against steady_clock
+        const auto clock_begin = std::chrono::steady_clock::now();
+        const std::uint64_t ticks_begin = Now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const std::uint64_t ticks = Now() - ticks_begin;
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - clock_begin).count();
+        ticks_per_ms_ = static_cast<double>(ticks) / ms;
+#endif
+    }
+
+    ThreadData* RegisterThread() {
+        std::lock_guard lock(mutex_);
+        // owned by the profiler so the data of finished threads stays in the totals and the trace
+        threads_.push_back(std::make_unique<ThreadData>());
+        threads_.back()->thread_index = threads_.size() - 1;
+        return threads_.back().get();
+    }
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadData>> threads_;
+    std::deque<FrameStats> history_;
+    std::array<std::uint64_t, kStageCount> last_stage_totals_{};
+    std::array<std::uint64_t, kCounterCount> last_counter_totals_{};
+    std::uint64_t frame_count_ = 0;
+    std::uint64_t start_ticks_;
+    double ticks_per_ms_ = 1e6;
+};
+
+class ProfileScope {
+public:
+    ProfileScope(const ProfileStage stage, const bool trace) : stage_(stage), trace_(trace), begin_(Profiler::Now()) { }
+    ~ProfileScope() { Profiler::Instance().Record(stage_, begin_, Profiler::Now(), trace_); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfileStage stage_;
+    bool trace_;
+    std::uint64_t begin_;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(stage) const ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(ProfileStage::stage, true)
+#define PROFILE_SCOPE_ACCUMULATE(stage) const ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(ProfileStage::stage, false)
+#define PROFILE_COUNT(counter, n) Profiler::Instance().Count(ProfileCounter::counter, n)
+#define PROFILE_FRAME_MARK() Profiler::Instance().MarkFrame()
+#define PROFILE_FRAME_SUMMARY() Profiler::Instance().GetFrameSummary()
+#define PROFILE_WRITE_TRACE(filename) Profiler::Instance().WriteChromeTrace(filename)
+
+#else
+
+#define PROFILE_SCOPE(stage)
+#define PROFILE_SCOPE_ACCUMULATE(stage)
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_FRAME_MARK()
+#define PROFILE_FRAME_SUMMARY() std::string()
+#define PROFILE_WRITE_TRACE(filename)
+
+#endif
+
+#endif //PROFILER_H
@@ -0,0 +1,69 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+#include <algorithm>
+#include <cmath>
+#include "frame_timer.h"
+
+/**
+ * @brief picks the resolution scale that holds the frame time of a FrameTimer at a target.
+ * rendering cost grows with the pixel count, the square of the scale, so the scale is corrected by the square root of
+ * target / frame time. frame times are smoothed and errors within a tolerance are ignored. the scale drops at once but
+ * grows in small steps, and waits a few frames after every change, so it settles instead of oscillating.
+ */
+class ResolutionController {
+public:
+    static constexpr float kStep = 1.0f / 32.0f;        // scales are multiples of it, fewer distinct frame sizes
+    static constexpr float kMaxIncrease = 0.05f;
+    static constexpr double kSmoothing = 0.25;          // weight of the newest frame time
+    static constexpr double kTolerance = 0.1;
+    static constexpr double kMaxLoad = 2.0;             // a single hitch (loading, moving the window) only counts this much
+    static constexpr int kSettleFrames = 6;
+
+    explicit ResolutionController(const double target_frame_time, const float min_scale = 0.5f, const float max_scale = 1.0f)
+        : target_frame_time_(target_frame_time), min_scale_(min_scale), max_scale_(max_scale), scale_(max_scale) { }
+
+    /**
+     * @brief feeds the time of the frame that just ended, returns the scale of the next frame.
+     */
+    float Update(const FrameTimer &timer) {
+        const double frame_time = std::min(timer.delta_time(), target_frame_time_ * kMaxLoad);
+        if (frame_time <= 0) return scale_;
+        smoothed_frame_time_ = smoothed_frame_time_ > 0 ? smoothed_frame_time_ + (frame_time - smoothed_frame_time_) * kSmoothing : frame_time;
+        if (settle_frames_ > 0) {
+            settle_frames_--;
+            return scale_;
+        }
+
+        const double load = smoothed_frame_time_ / target_frame_time_;
+        if (std::abs(load - 1.0) <= kTolerance) return scale_;
+        float scale = scale_ * static_cast<float>(std::sqrt(1.0 / load));
+        scale = std::min(scale, scale_ + kMaxIncrease);
+        scale = std::clamp(std::round(scale / kStep) * kStep, min_scale_, max_scale_);
+        if (scale != scale_) {
+            scale_ = scale;
+            settle_frames_ = kSettleFrames;
+        }
+        return scale_;
+    }
+
+    void Reset() {
+        scale_ = max_scale_;
+        smoothed_frame_time_ = 0;
+        settle_frames_ = 0;
+    }
+
+    [[nodiscard]] float scale() const { return scale_; }
+    [[nodiscard]] double target_frame_time() const { return target_frame_time_; }
+    [[nodiscard]] double smoothed_frame_time() const { return smoothed_frame_time_; }
+
+private:
+    double target_frame_time_;
+    float min_scale_;
+    float max_scale_;
+    float scale_;
+    double smoothed_frame_time_ = 0;
+    int settle_frames_ = 0;
+};
+
+#endif //RESOLUTION_CONTROLLER_H
@@ -0,0 +1,182 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief fixed size pool of worker threads.
+ * ParallelFor lets the calling thread take part in the work, so it is safe to nest it inside pool tasks.
+ */
+class ThreadPool {
+public:
+    static ThreadPool& Instance() {
+        static ThreadPool instance;
+        return instance;
+    }
+
+    explicit ThreadPool(size_t thread_count = std::max(1u, std::thread::hardware_concurrency())) {
+        for (size_t i = 0; i < thread_count; ++i)
+            workers_.emplace_back([this] { WorkerLoop(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        condition_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename F>
+    auto Submit(F&& func) -> std::future<std::invoke_result_t<F>> {
+        using Result = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+        std::future<Result> future = task->get_future();
+        Enqueue([task] { (*task)(); });
+        return future;
+    }
+
+    /**
+     * @brief calls func(i) for every i in [begin, end) and returns when all calls are done.
+     * func is called through a pointer and the loop state is recycled, so a loop makes no heap allocation.
+     */
+    template<typename F>
+    void ParallelFor(const size_t begin, const size_t end, F &&func) {
+        if (begin >= end) return;
+        const size_t count = end - begin;
+        if (count == 1 || workers_.empty() || concurrency_.load() == 1) {
+            for (size_t i = begin; i < end; ++i) func(i);
+            return;
+        }
+
+        size_t helpers = std::min(workers_.size(), count - 1);
+        if (const size_t concurrency = concurrency_.load(); concurrency > 0) helpers = std::min(helpers, concurrency - 1);
+        ParallelForState *state = AcquireState();
+        state->next = begin;
+        state->done = 0;
+        state->end = end;
+        state->count = count;
+        state->references = helpers + 1;
+        state->context = const_cast<void*>(static_cast<const void*>(std::addressof(func)));
+        state->invoke = [](void *context, const size_t i) { (*static_cast<std::remove_reference_t<F>*>(context))(i); };
+
+        for (size_t h = 0; h < helpers; ++h)
+            Enqueue([this, state] { RunParallelFor(*state); ReleaseState(state); });
+        RunParallelFor(*state);
+
+        {
+            std::unique_lock lock(state->mutex);
+            state->finished.wait(lock, [&] { return state->done.load() == count; });
+        }
+        ReleaseState(state);
+    }
+
+    /**
+     * @brief limits ParallelFor to n threads including the caller, 0 lets it use every worker.
+     */
+    void SetConcurrency(const size_t n) { concurrency_ = n; }
+
+    [[nodiscard]] size_t size() const { return workers_.size(); }
+
+private:
+    struct ParallelForState {
+        std::atomic<size_t> next {0};
+        std::atomic<size_t> done {0};
+        std::atomic<size_t> references {0};
+        size_t end = 0;
+        size_t count = 0;
+        void *context = nullptr;
+        void (*invoke)(void*, size_t) = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    // helpers that start after all indices are taken return immediately, the state outlives the caller until the
+    // last helper releases it, func is never called again by then
+    static void RunParallelFor(ParallelForState &state) {
+        size_t i;
+        while ((i = state.next.fetch_add(1)) < state.end) {
+            state.invoke(state.context, i);
+            if (state.done.fetch_add(1) + 1 == state.count) {
+                std::lock_guard lock(state.mutex);
+                state.finished.notify_all();
+            }
+        }
+    }
+
+    ParallelForState* AcquireState() {
+        std::lock_guard lock(states_mutex_);
+        if (free_states_.empty()) {
+            states_.push_back(std::make_unique<ParallelForState>());
+            return states_.back().get();
+        }
+        ParallelForState *state = free_states_.back();
+        free_states_.pop_back();
+        return state;
+    }
+
+    void ReleaseState(ParallelForState *state) {
+        if (state->references.fetch_sub(1) != 1) return;
+        std::lock_guard lock(states_mutex_);
+        free_states_.push_back(state);
+    }
+
+    // tasks live in a ring buffer that only grows, so queueing does not allocate once it is large enough
+    void Enqueue(std::function<void()> task) {
+        {
+            std::lock_guard lock(mutex_);
+            if (task_count_ == tasks_.size()) {
+                std::vector<std::function<void()>> tasks(std::max<size_t>(16, tasks_.size() * 2));
+                for (size_t i = 0; i < task_count_; ++i) tasks[i] = std::move(tasks_[(task_head_ + i) % tasks_.size()]);
+                tasks_ = std::move(tasks);
+                task_head_ = 0;
+            }
+            tasks_[(task_head_ + task_count_) % tasks_.size()] = std::move(task);
+            task_count_++;
+        }
+        condition_.notify_one();
+    }
+
+    void WorkerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex_);
+                condition_.wait(lock, [this] { return stop_ || task_count_ > 0; });
+                if (stop_ && task_count_ == 0) return;
+                task = std::move(tasks_[task_head_]);
+                tasks_[task_head_] = nullptr;
+                task_head_ = (task_head_ + 1) % tasks_.size();
+                task_count_--;
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::vector<std::function<void()>> tasks_;
+    size_t task_head_ = 0;
+    size_t task_count_ = 0;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_ = false;
+    std::atomic<size_t> concurrency_ {0};
+    std::mutex states_mutex_;
+    std::vector<std::unique_ptr<ParallelForState>> states_;
+    std::vector<ParallelForState*> free_states_;
+};
+
+#endif //THREAD_POOL_H
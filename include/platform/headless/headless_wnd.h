@@ -0,0 +1,75 @@
+#ifndef HEADLESS_WND_H
+#define HEADLESS_WND_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "../iwindow.h"
+
+/**
+ * @brief header at the start of the frame ring file, padded to 64 bytes.
+ * file layout: HeadlessRingHeader | slot_count x (HeadlessSlotHeader | width * height BGRA pixels, top-left origin),
+ * slot_stride is a multiple of 64 so that every slot header starts on a cache line.
+ */
+struct alignas(64) HeadlessRingHeader {
+    char          magic[8] = {'H', 'M', 'X', 'S', 'R', 'I', 'N', 'G'};
+    std::uint32_t version = 2;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::uint32_t bpp = 4;
+    std::uint32_t slot_count = 0;
+    std::uint32_t reserved = 0;
+    alignas(8) std::uint64_t slot_stride = 0;               // bytes from one slot header to the next
+    alignas(8) std::atomic<std::uint64_t> frame_count {0};  // frames published so far, the latest one is in slot (frame_count - 1) % slot_count
+};
+
+/**
+ * @brief header of one slot, sequence is odd while the slot is being written (seqlock).
+ */
+struct alignas(64) HeadlessSlotHeader {
+    alignas(8) std::atomic<std::uint64_t> sequence {0};
+    alignas(8) std::uint64_t frame_index = 0;
+    char text[4096] = {};
+};
+
+// the file is shared with other processes, its layout may not depend on the compiler
+static_assert(sizeof(HeadlessRingHeader) == 64 && offsetof(HeadlessRingHeader, frame_count) == 40);
+static_assert(sizeof(HeadlessSlotHeader) == 4160 && offsetof(HeadlessSlotHeader, text) == 16);
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+/**
+ * @brief window-less presenter, publishes frames into a memory mapped ring file.
+ * another process maps the same file and reads the latest slot in place, without any copy or socket in between.
+ * there is no input device, the window closes on SIGINT/SIGTERM or after an optional number of frames.
+ */
+class HeadlessWnd final : public IWindow {
+public:
+    explicit HeadlessWnd(std::string ring_path, std::uint32_t slot_count = 3);
+    ~HeadlessWnd() override;
+
+    void OpenWnd(int width, int height) override;
+    void PushBuffer(const ColorBuffer &buffer) override;
+    void PushText(const std::string &text) override;
+    void UpdateWnd() override;
+    void HandleMsg() override;
+
+    void SetFrameLimit(const std::uint64_t frame_limit) { frame_limit_ = frame_limit; }
+
+private:
+    [[nodiscard]] HeadlessSlotHeader* Slot(std::uint64_t frame) const;
+    HeadlessSlotHeader* BeginWrite();
+
+    std::string ring_path_;
+    std::uint32_t slot_count_;
+    int width_ = 0, height_ = 0;
+    int fd_ = -1;
+    std::uint8_t* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    std::uint64_t frame_ = 0;       // frame currently written
+    bool writing_ = false;
+    std::uint64_t frame_limit_ = 0; // 0 = unlimited
+};
+
+#endif //HEADLESS_WND_H
@@ -0,0 +1,57 @@
+#ifndef IWINDOW_H
+#define IWINDOW_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../core/buffer.h"
+
+typedef enum { A, D, W, S, Q, E, O, C, M, V, SPACE, ESC, ENTER } KeyCode;
+typedef enum { L, R } MouseCode;
+
+/**
+ * @brief platform independent window interface: pixel presentation, text overlay and input callbacks.
+ */
+class IWindow {
+public:
+    virtual ~IWindow() = default;
+
+    virtual void OpenWnd(int width, int height) = 0;
+    virtual void PushBuffer(const ColorBuffer &buffer) = 0;
+    virtual void PushText(const std::string &text) = 0;
+    virtual void UpdateWnd() = 0;
+    virtual void CloseWnd() { is_running_ = false; }
+    virtual void HandleMsg() = 0;
+
+    virtual void SetTextFont(const std::string &, int) { }
+
+    void RegisterKeyCallback(const std::function<void(IWindow*, KeyCode)> &callback) { key_callbacks_.push_back(callback); }
+    void RegisterMouseCallback(const std::function<void(IWindow*, MouseCode)> &callback) { mouse_callbacks_.push_back(callback); }
+    void RegisterScrollCallback(const std::function<void(IWindow*, double)> &callback) { scroll_callbacks_.push_back(callback); }
+    void ClearKeyCallbacks() { key_callbacks_.clear(); }
+    void ClearMouseCallbacks() { mouse_callbacks_.clear(); }
+    void ClearScrollCallbacks() { scroll_callbacks_.clear(); }
+
+    void SetUserData(const std::shared_ptr<void> &data) { user_data_ = data; }
+    [[nodiscard]] std::shared_ptr<void> GetUserData() const { return user_data_; }
+
+    [[nodiscard]] bool is_running() const { return is_running_; }
+
+protected:
+    void DispatchKey(const KeyCode key_code) { for (auto& callback : key_callbacks_) callback(this, key_code); }
+    void DispatchMouse(const MouseCode mouse_code) { for (auto& callback : mouse_callbacks_) callback(this, mouse_code); }
+    void DispatchScroll(const double offset) { for (auto& callback : scroll_callbacks_) callback(this, offset); }
+
+    bool is_running_ = false;
+
+private:
+    std::shared_ptr<void> user_data_;
+
+    std::vector<std::function<void(IWindow*, KeyCode)>> key_callbacks_;
+    std::vector<std::function<void(IWindow*, MouseCode)>> mouse_callbacks_;
+    std::vector<std::function<void(IWindow*, double)>> scroll_callbacks_;
+};
+
+#endif //IWINDOW_H
@@ -7,43 +7,26 @@
 #include <cstdint>
 #include <functional>
 
-#include "../core/buffer.h"
-
-typedef enum { A, D, W, S, Q, E, SPACE, ESC, ENTER } KeyCode;
-typedef enum { L, R } MouseCode;
+#include "../iwindow.h"
 
 /**
  * @brief window class based on Win32 API using GDI to draw pixels and text.
  */
-class Win32Wnd {
+class Win32Wnd final : public IWindow {
 public:
     Win32Wnd(const LPCSTR &class_name, const LPCSTR &window_title);
-    ~Win32Wnd();
+    ~Win32Wnd() override;
 
-    void OpenWnd(int width, int height);
-    void PushBuffer(const ColorBuffer &buffer) const;
-    void PushText(const std::string &text);
-    void UpdateWnd() const;
-    void CloseWnd();
+    void OpenWnd(int width, int height) override;
+    void PushBuffer(const ColorBuffer &buffer) override;
+    void PushText(const std::string &text) override;
+    void UpdateWnd() override;
+    void HandleMsg() override;
 
-    void SetTextFont(const std::string &font_name, int font_size);
+    void SetTextFont(const std::string &font_name, int font_size) override;
     void SetTextColorRef(const COLORREF &color) { text_color_ = color; }
     void SetTextOffset(const Vector2i &offset) { text_offset_ = offset; }
 
-    void RegisterKeyCallback(const std::function<void(Win32Wnd*, KeyCode)> &callback) { key_callbacks_.push_back(callback); }
-    void RegisterMouseCallback(const std::function<void(Win32Wnd*, MouseCode)> &callback) { mouse_callbacks_.push_back(callback); }
-    void RegisterScrollCallback(const std::function<void(Win32Wnd*, double)> &callback) { scroll_callbacks_.push_back(callback); }
-    void ClearKeyCallbacks() { key_callbacks_.clear(); }
-    void ClearMouseCallbacks() { mouse_callbacks_.clear(); }
-    void ClearScrollCallbacks() { scroll_callbacks_.clear(); }
-
-    void SetUserData(const std::shared_ptr<void> &data) { user_data_ = data; }
-    [[nodiscard]] std::shared_ptr<void> GetUserData() const { return user_data_; }
-
-    [[nodiscard]] bool is_running() const { return is_running_; }
-
-    static void HandleMsg();
-
 private:
     void RegisterWndClass() const;
     void CreateWnd();
@@ -71,14 +54,6 @@ private:
     SIZE text_size_;        // text size
     COLORREF text_color_;   // text color
     Vector2i text_offset_;  // text offset
-
-    bool is_running_;
-
-    std::shared_ptr<void> user_data_;
-
-    std::vector<std::function<void(Win32Wnd*, KeyCode)>> key_callbacks_;
-    std::vector<std::function<void(Win32Wnd*, MouseCode)>> mouse_callbacks_;
-    std::vector<std::function<void(Win32Wnd*, double)>> scroll_callbacks_;
 };
 
 #endif //WIN32WND_H
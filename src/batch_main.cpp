@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include "utility/log.h"
+#include "utility/thread_pool.h"
+#include "asset_manager.h"
+#include "scene.h"
+#include "tga_handler.h"
+
+/**
+ * offline batch renderer: renders the frames of a scene description file and writes them as .tga files.
+ *
+ * usage: Graphics_HmxsRenderer_Batch <scene file> [--jobs N] [--writers N]
+ *   --jobs     frames rendered concurrently (default: a quarter of the cores)
+ *   --writers  threads encoding and writing frames (default: 2)
+ *
+ * scene file, one statement per line, lines starting with '#' are comments:
+ *   resolution <width> <height>
+ *   frames <count>
+ *   output <path with # for the zero-padded frame index>, e.g. renders/frame_####.tga
+ *   rle <0|1>
+ *   msaa <1|2|4|8>                          samples per pixel
+ *   shader <Fixed|Gray|Phong|BlinnPhong|Normal|Tangent|Deferred>
+ *   quantize <0|1>                          models after it use the quantized vertex format
+ *   model <obj path, e.g. /african_head/african_head.obj, looked up in the assets folder if not found as given> [x y z]
+ *   light <dx dy dz>
+ *   camera <fov> <z_near> <z_far>
+ *   key <frame> <x y z> <pitch yaw roll>   camera keyframe, linearly interpolated
+ *   turntable <degrees>                     models rotate around y over the whole sequence
+ */
+
+namespace {
+    struct CameraKey {
+        int frame = 0;
+        Vector3f position;
+        Vector3f rotation;
+    };
+
+    struct ModelEntry {
+        std::shared_ptr<Model> model;
+        std::string name;
+        Vector3f position;
+    };
+
+    struct BatchDescription {
+        int width = 512;
+        int height = 512;
+        int frames = 1;
+        std::string output = "frame_####.tga";
+        bool rle = true;
+        int msaa = 1;
+        bool quantize = false;
+        std::string shader = "BlinnPhong";
+        std::vector<ModelEntry> models{};
+        std::vector<Light> lights{};
+        float fov = 40.0f, z_near = 0.1f, z_far = 1000.0f;
+        std::vector<CameraKey> keys{};
+        float turntable = 0.0f;
+    };
+
+    std::vector<std::shared_ptr<IShader>> CreateShaders() {
+        return {
+            std::make_shared<FixedShader>(),
+            std::make_shared<GrayShader>(),
+            std::make_shared<PhongShader>(),
+            std::make_shared<BlinnPhongShader>(),
+            std::make_shared<NormalShader>(),
+            std::make_shared<NormalTangentShader>(),
+            std::make_shared<DeferredShader>()
+        };
+    }
+
+    bool LoadDescription(const std::string &filename, BatchDescription &desc) {
+        std::ifstream in(filename);
+        if (!in.is_open()) {
+            LOG_ERROR("Batch - cannot open scene file: " + filename);
+            return false;
+        }
+        std::string line;
+        int line_number = 0;
+        while (std::getline(in, line)) {
+            line_number++;
+            std::istringstream iss(line);
+            std::string keyword;
+            if (!(iss >> keyword) || keyword.front() == '#') continue;
+            bool ok = true;
+            if (keyword == "resolution") {
+                ok = static_cast<bool>(iss >> desc.width >> desc.height) && desc.width > 0 && desc.height > 0;
+            } else if (keyword == "frames") {
+                ok = static_cast<bool>(iss >> desc.frames) && desc.frames > 0;
+            } else if (keyword == "output") {
+                ok = static_cast<bool>(iss >> desc.output);
+            } else if (keyword == "rle") {
+                ok = static_cast<bool>(iss >> desc.rle);
+            } else if (keyword == "msaa") {
+                ok = static_cast<bool>(iss >> desc.msaa) && MultisampleBuffer::GetSamplePositions(desc.msaa) != nullptr;
+            } else if (keyword == "shader") {
+                ok = static_cast<bool>(iss >> desc.shader);
+            } else if (keyword == "quantize") {
+                ok = static_cast<bool>(iss >> desc.quantize);
+            } else if (keyword == "model") {
+                ModelEntry entry;
+                std::string path;
+                ok = static_cast<bool>(iss >> path);
+                if (ok) {
+                    iss >> entry.position[0] >> entry.position[1] >> entry.position[2];
+                    const std::string model_path = std::filesystem::exists(path) ? path : std::string(ASSETS_PATH) + path;
+                    entry.model = AssetManager::Instance().LoadModel(model_path, desc.quantize ? QUANTIZED : FULL_PRECISION);
+                    entry.name = path;
+                    ok = entry.model->faces_size() > 0;
+                    desc.models.push_back(entry);
+                }
+            } else if (keyword == "light") {
+                Light light {.direction = {0, 0, 0}, .intensity = {1, 1, 1}};
+                ok = static_cast<bool>(iss >> light.direction[0] >> light.direction[1] >> light.direction[2]);
+                desc.lights.push_back(light);
+            } else if (keyword == "camera") {
+                ok = static_cast<bool>(iss >> desc.fov >> desc.z_near >> desc.z_far);
+            } else if (keyword == "key") {
+                CameraKey key;
+                ok = static_cast<bool>(iss >> key.frame >> key.position[0] >> key.position[1] >> key.position[2]
+                                           >> key.rotation[0] >> key.rotation[1] >> key.rotation[2]);
+                desc.keys.push_back(key);
+            } else if (keyword == "turntable") {
+                ok = static_cast<bool>(iss >> desc.turntable);
+            } else {
+                ok = false;
+            }
+            if (!ok) {
+                LOG_ERROR("Batch - " + filename + ":" + std::to_string(line_number) + " cannot parse: " + line);
+                return false;
+            }
+        }
+        if (desc.models.empty()) {
+            LOG_ERROR("Batch - scene file has no model");
+            return false;
+        }
+        if (desc.lights.empty()) desc.lights.push_back({.direction = {1, 1, 1}, .intensity = {1, 1, 1}});
+        if (desc.keys.empty()) desc.keys.push_back({.frame = 0, .position = {0, 0.5, 5}, .rotation = {0, 0, 0}});
+        std::sort(desc.keys.begin(), desc.keys.end(), [](const CameraKey &a, const CameraKey &b) { return a.frame < b.frame; });
+        return true;
+    }
+
+    CameraKey SampleCamera(const std::vector<CameraKey> &keys, const int frame) {
+        if (frame <= keys.front().frame) return keys.front();
+        for (size_t i = 1; i < keys.size(); ++i) {
+            if (frame > keys[i].frame) continue;
+            const float t = static_cast<float>(frame - keys[i - 1].frame) / static_cast<float>(std::max(1, keys[i].frame - keys[i - 1].frame));
+            return {frame, keys[i - 1].position * (1 - t) + keys[i].position * t, keys[i - 1].rotation * (1 - t) + keys[i].rotation * t};
+        }
+        return keys.back();
+    }
+
+    std::string GetOutputPath(const std::string &pattern, const int frame) {
+        const size_t first = pattern.find('#');
+        if (first == std::string::npos) return pattern;
+        const size_t last = pattern.find_first_not_of('#', first);
+        const size_t width = (last == std::string::npos ? pattern.size() : last) - first;
+        std::string index = std::to_string(frame);
+        if (index.size() < width) index.insert(0, width - index.size(), '0');
+        return pattern.substr(0, first) + index + (last == std::string::npos ? "" : pattern.substr(last));
+    }
+
+    /**
+     * @brief per render job state, every job owns its scene objects and two frame buffers.
+     * a frame is encoded from one buffer while the next frame renders into the other one.
+     */
+    struct RenderJob {
+        Scene scene;
+        std::shared_ptr<FrameBuffer> frame_buffers[2];
+        std::future<bool> pending_writes[2];
+    };
+
+    struct StageTimes {
+        std::atomic<std::int64_t> render_us {0};
+        std::atomic<std::int64_t> write_us {0};
+    };
+
+    std::int64_t MicrosecondsSince(const std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    if (argc < 2) {
+        LOG_ERROR("usage: Graphics_HmxsRenderer_Batch <scene file> [--jobs N] [--writers N]");
+        return 1;
+    }
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency() / 4);
+    size_t writers = 2;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        if (option == "--jobs") jobs = std::max(1, std::atoi(argv[i + 1]));
+        else if (option == "--writers") writers = std::max(1, std::atoi(argv[i + 1]));
+        else LOG_WARNING("Batch - unknown option: " + option);
+    }
+
+    BatchDescription desc;
+    if (!LoadDescription(argv[1], desc)) return 1;
+    const auto shaders = CreateShaders();
+    const auto shader = std::find_if(shaders.begin(), shaders.end(), [&](const auto &s) { return s->name == desc.shader; });
+    if (shader == shaders.end()) {
+        LOG_ERROR("Batch - unknown shader: " + desc.shader);
+        return 1;
+    }
+    jobs = std::min(jobs, static_cast<size_t>(desc.frames));
+    // every frame is written out, none may be rendered before its maps arrive
+    for (const auto &entry : desc.models) entry.model->WaitForTextures((*shader)->texture_slots);
+
+    // scene objects are per job, models and shaders are shared read-only
+    std::vector<std::unique_ptr<RenderJob>> render_jobs;
+    for (size_t j = 0; j < jobs; ++j) {
+        auto job = std::make_unique<RenderJob>();
+        job->frame_buffers[0] = std::make_shared<FrameBuffer>(desc.width, desc.height, RGBA, desc.msaa);
+        job->frame_buffers[1] = std::make_shared<FrameBuffer>(desc.width, desc.height, RGBA, desc.msaa);
+        job->scene.camera_obj = std::make_shared<CameraObject>();
+        job->scene.camera_obj->camera = Camera(desc.fov, static_cast<float>(desc.width) / static_cast<float>(desc.height), desc.z_near, desc.z_far);
+        job->scene.g_buffer = std::make_shared<GBuffer>(desc.width, desc.height);
+        job->scene.shader_list.push_back(*shader);
+        job->scene.render_path = (*shader)->name == "Deferred" ? DEFERRED : FORWARD;
+        job->scene.msaa_samples = desc.msaa;
+        job->scene.lights = desc.lights;
+        for (const auto &[model, name, position] : desc.models) {
+            auto mesh_obj = std::make_shared<MeshObject>(name);
+            mesh_obj->mesh = std::make_shared<Mesh>(model);
+            mesh_obj->SetPosition(position);
+            job->scene.mesh_objs.push_back(mesh_obj);
+        }
+        render_jobs.push_back(std::move(job));
+    }
+
+    LOG_INFO("Batch - rendering " + std::to_string(desc.frames) + " frames of " + std::to_string(desc.width) + " x " + std::to_string(desc.height)
+             + " with " + std::to_string(jobs) + " job(s) and " + std::to_string(writers) + " writer(s)");
+
+    ThreadPool writer_pool(writers);
+    StageTimes times;
+    std::atomic<int> next_frame {0};
+    std::atomic<int> failed_writes {0};
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (const auto &job : render_jobs) {
+        threads.emplace_back([&, job = job.get()] {
+            size_t buffer_index = 0;
+            int frame;
+            while ((frame = next_frame.fetch_add(1)) < desc.frames) {
+                // wait until the previous write from this buffer is done before reusing it
+                auto &pending = job->pending_writes[buffer_index];
+                if (pending.valid() && !pending.get()) ++failed_writes;
+                const auto frame_buffer = job->frame_buffers[buffer_index];
+
+                const auto render_start = std::chrono::steady_clock::now();
+                const CameraKey camera = SampleCamera(desc.keys, frame);
+                job->scene.camera_obj->SetPosition(camera.position);
+                job->scene.camera_obj->SetRotation(camera.rotation);
+                const float angle = desc.turntable * static_cast<float>(frame) / static_cast<float>(desc.frames);
+                for (const auto &mesh_obj : job->scene.mesh_objs) mesh_obj->SetRotation({0, angle, 0});
+                frame_buffer->Clear();
+                job->scene.g_buffer->Clear();
+                job->scene.frame_buffer = frame_buffer;
+                job->scene.Render();
+                times.render_us += MicrosecondsSince(render_start);
+
+                pending = writer_pool.Submit([&, frame_buffer, frame] {
+                    const auto write_start = std::chrono::steady_clock::now();
+                    const bool written = TGAHandler::WriteTGAFile(GetOutputPath(desc.output, frame), frame_buffer->color_buffer, false, desc.rle);
+                    times.write_us += MicrosecondsSince(write_start);
+                    return written;
+                });
+                buffer_index ^= 1;
+            }
+            for (auto &pending : job->pending_writes)
+                if (pending.valid() && !pending.get()) ++failed_writes;
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    const double total_s = static_cast<double>(MicrosecondsSince(start)) / 1e6;
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2)
+        << "Batch - " << desc.frames << " frames in " << total_s << " s, " << desc.frames / total_s << " frames/s"
+        << " | render " << static_cast<double>(times.render_us) / 1e3 / desc.frames << " ms/frame"
+        << " | encode+write " << static_cast<double>(times.write_us) / 1e3 / desc.frames << " ms/frame";
+    LOG_INFO(oss.str());
+    if (failed_writes > 0) {
+        LOG_ERROR("Batch - " + std::to_string(failed_writes.load()) + " frame(s) could not be written");
+        return 1;
+    }
+    return 0;
+}
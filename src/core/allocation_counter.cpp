@@ -0,0 +1,54 @@
+#include "utility/allocation_counter.h"
+
+#ifdef HMXS_COUNT_ALLOCATIONS
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "utility/log.h"
+
+AllocationCounter::FrameScope::FrameScope() {
+    open_scopes_.fetch_add(1);
+    begin_ = allocations_.load();
+}
+
+AllocationCounter::FrameScope::~FrameScope() {
+    const std::uint64_t count = allocations_.load() - begin_;
+    open_scopes_.fetch_sub(1);
+    last_frame_ = count;
+    // frames rendered concurrently (batch jobs) count each other's allocations as well
+    if (const std::uint64_t frame = frame_count_.fetch_add(1); count > 0 && frame >= kWarmupFrames)
+        LOG_WARNING("AllocationCounter - frame " + std::to_string(frame) + " made " + std::to_string(count) + " heap allocation(s)");
+}
+
+// replacements of the global allocation functions, the array and nothrow forms forward to these
+void* operator new(const std::size_t size) {
+    AllocationCounter::OnAllocation();
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment) {
+    AllocationCounter::OnAllocation();
+    const auto align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+    if (void *ptr = _aligned_malloc(size == 0 ? 1 : size, align)) return ptr;
+#else
+    if (void *ptr = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)) return ptr;
+#endif
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+#ifdef _WIN32
+void operator delete(void *ptr, std::align_val_t) noexcept { _aligned_free(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { _aligned_free(ptr); }
+#else
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+#include "asset_manager.h"
+#include <filesystem>
+#include "utility/log.h"
+#include "utility/thread_pool.h"
+#include "tga_handler.h"
+
+namespace {
+    // the first caller of a key loads it on its own thread, later callers wait for that load
+    template<typename T, typename Load>
+    std::shared_ptr<T> LoadOnce(std::mutex &mutex, std::unordered_map<std::string, std::shared_future<std::shared_ptr<T>>> &assets,
+                                const std::string &key, Load &&load) {
+        std::promise<std::shared_ptr<T>> promise;
+        std::shared_future<std::shared_ptr<T>> future;
+        bool owner = false;
+        {
+            std::lock_guard lock(mutex);
+            if (const auto it = assets.find(key); it != assets.end()) {
+                future = it->second;
+            } else {
+                future = promise.get_future().share();
+                assets.emplace(key, future);
+                owner = true;
+            }
+        }
+        if (owner) {
+            try {
+                promise.set_value(load());
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        }
+        return future.get();
+    }
+
+    std::string GetModelKey(const std::string &key, const MeshFormat format) {
+        return format == QUANTIZED ? key + "#quantized" : key;
+    }
+}
+
+AssetHandle<Model> AssetManager::LoadModelAsync(const std::string &filename, const MeshFormat format) {
+    const std::string key = GetModelKey(GetKey(filename), format);
+    std::lock_guard lock(mutex_);
+    auto it = models_.find(key);
+    if (it == models_.end()) {
+        LOG_DEBUG("AssetManager - loading " + filename + " in the background");
+        auto future = ThreadPool::Instance().Submit([filename, format] { return std::make_shared<Model>(filename, format); }).share();
+        it = models_.emplace(key, std::move(future)).first;
+    }
+    return {it->second, placeholder_model_};
+}
+
+std::shared_ptr<Model> AssetManager::LoadModel(const std::string &filename, const MeshFormat format) {
+    return LoadOnce(mutex_, models_, GetModelKey(GetKey(filename), format), [&] { return std::make_shared<Model>(filename, format); });
+}
+
+AssetHandle<const ColorBuffer> AssetManager::LoadTextureAsync(const std::string &filename) {
+    const std::string key = GetKey(filename);
+    std::lock_guard lock(mutex_);
+    auto it = textures_.find(key);
+    if (it == textures_.end()) {
+        LOG_DEBUG("AssetManager - loading " + filename + " in the background");
+        auto future = ThreadPool::Instance().Submit([filename] { return std::shared_ptr<const ColorBuffer>(TGAHandler::ReadTGAFile(filename, true)); }).share();
+        it = textures_.emplace(key, std::move(future)).first;
+    }
+    return {it->second, nullptr};
+}
+
+std::shared_ptr<const ColorBuffer> AssetManager::LoadTexture(const std::string &filename) {
+    return LoadOnce(mutex_, textures_, GetKey(filename), [&] { return std::shared_ptr<const ColorBuffer>(TGAHandler::ReadTGAFile(filename, true)); });
+}
+
+void AssetManager::SetPlaceholderModel(std::shared_ptr<Model> model) {
+    std::lock_guard lock(mutex_);
+    placeholder_model_ = std::move(model);
+}
+
+size_t AssetManager::ReleaseUnused() {
+    const auto release = [](auto &assets) {
+        size_t released = 0;
+        for (auto it = assets.begin(); it != assets.end();) {
+            // the cached future holds one reference itself
+            const bool unused = it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready && it->second.get().use_count() <= 1;
+            it = unused ? assets.erase(it) : std::next(it);
+            released += unused;
+        }
+        return released;
+    };
+    std::lock_guard lock(mutex_);
+    const size_t released = release(models_) + release(textures_);
+    if (released > 0) LOG_DEBUG("AssetManager - released " + std::to_string(released) + " unused asset(s)");
+    return released;
+}
+
+std::string AssetManager::GetKey(const std::string &filename) {
+    std::error_code error;
+    const std::filesystem::path path = std::filesystem::weakly_canonical(filename, error);
+    return error ? filename : path.generic_string();
+}
@@ -1,37 +1,92 @@
 #include "buffer.h"
 #include <algorithm>
+#include <bit>
+
+// TileClearState
+TileClearState::TileClearState(const size_t width, const size_t height)
+    : width_(width), height_(height),
+      tiles_x_((width + kTileSize - 1) / kTileSize), tiles_y_((height + kTileSize - 1) / kTileSize),
+      flags_(std::make_unique<std::uint8_t[]>(tiles_x_ * tiles_y_)) {
+}
+
+void TileClearState::MarkAll() const {
+    std::fill_n(flags_.get(), tiles_x_ * tiles_y_, 1);
+    pending_ = tiles_x_ * tiles_y_ > 0;
+}
 
 // ColorBuffer
 ColorBuffer::ColorBuffer()
-    : width_(0), height_(0), bpp_(0), data_(nullptr) {
+    : width_(0), height_(0), bpp_(0) {
 }
 
 ColorBuffer::ColorBuffer(const size_t width, const size_t height, const uint8_t bpp)
-    : width_(width), height_(height), bpp_(bpp), data_(nullptr) {
+    : width_(width), height_(height), bpp_(bpp), row_stride_(static_cast<std::ptrdiff_t>(width * bpp)), pixel_stride_(bpp),
+      clear_state_(width, height) {
+    assert(bpp == GRAYSCALE || bpp == RGB || bpp == RGBA);
+    const auto pixels = std::make_shared<std::uint8_t[]>(width * height * bpp); // value-initialized, already cleared to 0
+    origin_ = pixels.get();
+    storage_ = pixels;
+}
+
+ColorBuffer::ColorBuffer(const std::uint8_t *origin, const size_t width, const size_t height, const uint8_t bpp,
+                         const std::ptrdiff_t row_stride, std::shared_ptr<const void> storage)
+    : width_(width), height_(height), bpp_(bpp), row_stride_(row_stride), pixel_stride_(bpp),
+      origin_(const_cast<std::uint8_t*>(origin)), storage_(std::move(storage)), read_only_(true), clear_state_(width, height) {
     assert(bpp == GRAYSCALE || bpp == RGB || bpp == RGBA);
-    data_ = std::make_unique<std::uint8_t[]>(width * height * bpp);
-    Clear();
 }
 
 std::uint8_t& ColorBuffer::operator[](const size_t index) {
-    assert(index < width_ * height_ * bpp_);
-    return data_[index];
+    assert(index < width_ * height_ * bpp_ && is_contiguous() && !read_only_);
+    Resolve();
+    return origin_[index];
 }
 
 std::uint8_t ColorBuffer::operator[](const size_t index) const {
-    assert(index < width_ * height_ * bpp_);
-    return data_[index];
+    assert(index < width_ * height_ * bpp_ && is_contiguous());
+    Resolve();
+    return origin_[index];
 }
 
 void ColorBuffer::SetPixel(const size_t x, const size_t y, const Color &color) const {
-    assert(x < width_ && y < height_ && data_ != nullptr);
-    std::copy_n(color.bgra_array.begin(), bpp_, data_.get() + (x + y * width_) * bpp_);
+    assert(x < width_ && y < height_ && origin_ != nullptr && !read_only_);
+    clear_state_.Materialize(x, y, [this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
+    std::copy_n(color.bgra_array.begin(), bpp_, Pixel(x, y));
+}
+
+void ColorBuffer::SetRow(const size_t y, const std::uint8_t *pixels) const {
+    assert(y < height_ && origin_ != nullptr && !read_only_);
+    for (size_t x = 0; x < width_; x += TileClearState::kTileSize)
+        clear_state_.Materialize(x, y, [this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
+    if (pixel_stride_ == bpp_) {
+        std::copy_n(pixels, width_ * bpp_, Pixel(0, y));
+        return;
+    }
+    for (size_t x = 0; x < width_; ++x)
+        std::copy_n(pixels + x * bpp_, bpp_, Pixel(x, y));
+}
+
+void ColorBuffer::GetRow(const size_t y, std::uint8_t *pixels, const size_t count) const {
+    assert(y < height_ && count <= width_ && origin_ != nullptr);
+    for (size_t x0 = 0; x0 < count; x0 += TileClearState::kTileSize) {
+        const size_t x1 = std::min(x0 + TileClearState::kTileSize, count);
+        if (clear_state_.IsCleared(x0, y)) {
+            std::fill_n(pixels + x0 * bpp_, (x1 - x0) * bpp_, clear_value_);
+        } else if (pixel_stride_ == bpp_) {
+            std::copy_n(Pixel(x0, y), (x1 - x0) * bpp_, pixels + x0 * bpp_);
+        } else {
+            for (size_t x = x0; x < x1; ++x) std::copy_n(Pixel(x, y), bpp_, pixels + x * bpp_);
+        }
+    }
 }
 
 Color ColorBuffer::GetPixel(const size_t x, const size_t y) const {
-    assert(x < width_ && y < height_ && data_ != nullptr);
+    assert(x < width_ && y < height_ && origin_ != nullptr);
     Color ret = {0, 0, 0, 0};
-    std::copy_n(data_.get() + (x + y * width_) * bpp_, bpp_, ret.bgra_array.begin());
+    if (clear_state_.IsCleared(x, y)) {
+        std::fill_n(ret.bgra_array.begin(), bpp_, clear_value_);
+        return ret;
+    }
+    std::copy_n(Pixel(x, y), bpp_, ret.bgra_array.begin());
     return ret;
 }
 
@@ -43,25 +98,64 @@ Color ColorBuffer::GetPixel(Vector2f uv) const {
 }
 
 void ColorBuffer::FlipVertically() {
-    const size_t half = height_ >> 1;
-    for (int x = 0; x < width_; ++x)
-        for (int y = 0; y < half; ++y)
-            for (int b = 0; b < bpp_; ++b)
-                std::swap(data_[(x + y * width_) * bpp_ + b],
-                          data_[(x + (height_ - 1 - y) * width_) * bpp_ + b]);
+    // pending clears are laid out in view coordinates, they are filled before the view turns
+    Resolve();
+    if (height_ == 0) return;
+    origin_ += static_cast<std::ptrdiff_t>(height_ - 1) * row_stride_;
+    row_stride_ = -row_stride_;
 }
 
 void ColorBuffer::FlipHorizontally() {
-    const size_t half = width_ >> 1;
-    for (int x = 0; x < half; ++x)
-        for (int y = 0; y < height_; ++y)
-            for (int b = 0; b < bpp_; ++b)
-                std::swap(data_[(x + y * width_) * bpp_ + b],
-                          data_[(width_ - 1 - x + y * width_) * bpp_ + b]);
+    Resolve();
+    if (width_ == 0) return;
+    origin_ += static_cast<std::ptrdiff_t>(width_ - 1) * pixel_stride_;
+    pixel_stride_ = -pixel_stride_;
+}
+
+ColorBuffer ColorBuffer::View(const size_t x, const size_t y, const size_t width, const size_t height) const {
+    assert(x + width <= width_ && y + height <= height_);
+    Resolve();
+    ColorBuffer view;
+    view.width_ = width;
+    view.height_ = height;
+    view.bpp_ = bpp_;
+    view.row_stride_ = row_stride_;
+    view.pixel_stride_ = pixel_stride_;
+    view.origin_ = Pixel(x, y);
+    view.storage_ = storage_;
+    view.read_only_ = read_only_;
+    view.clear_state_ = TileClearState(width, height);
+    return view;
+}
+
+void ColorBuffer::CopyTo(std::uint8_t *out) const {
+    const size_t row_size = width_ * bpp_;
+    for (size_t y = 0; y < height_; ++y, out += row_size) {
+        const std::uint8_t *src = row(y);
+        if (pixel_stride_ == bpp_) {
+            std::copy_n(src, row_size, out);
+            continue;
+        }
+        for (size_t x = 0; x < width_; ++x, src += pixel_stride_)
+            std::copy_n(src, bpp_, out + x * bpp_);
+    }
 }
 
 void ColorBuffer::Clear(const uint8_t value) const {
-    std::fill_n(data_.get(), width_ * height_ * bpp_, value);
+    assert(!read_only_);
+    clear_value_ = value;
+    clear_state_.MarkAll();
+}
+
+void ColorBuffer::Resolve() const {
+    clear_state_.Resolve([this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
+}
+
+void ColorBuffer::FillRect(const size_t x0, const size_t x1, const size_t y0, const size_t y1) const {
+    // every byte gets the same value, so a mirrored row is filled from its lowest address
+    const size_t first = pixel_stride_ > 0 ? x0 : x1 - 1;
+    for (size_t y = y0; y < y1; ++y)
+        std::fill_n(Pixel(first, y), (x1 - x0) * bpp_, clear_value_);
 }
 
 // DepthBuffer
@@ -70,46 +164,165 @@ DepthBuffer::DepthBuffer()
 }
 
 DepthBuffer::DepthBuffer(const size_t width, const size_t height)
-    : width_(width), height_(height), data_(nullptr) {
+    : width_(width), height_(height), data_(nullptr), clear_state_(width, height) {
     data_ = std::make_unique<float[]>(width * height);
     Clear();
 }
 
 float& DepthBuffer::operator[](const size_t index) {
     assert(index < width_ * height_);
+    Resolve();
     return data_[index];
 }
 
 float DepthBuffer::operator[](const size_t index) const {
     assert(index < width_ * height_);
+    Resolve();
     return data_[index];
 }
 
 void DepthBuffer::Set(const size_t x, const size_t y, const float depth) const {
     assert(x < width_ && y < height_ && data_ != nullptr);
+    clear_state_.Materialize(x, y, [this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
     data_[x + y * width_] = depth;
 }
 
 float DepthBuffer::Get(const size_t x, const size_t y) const {
     assert(x < width_ && y < height_ && data_ != nullptr);
+    if (clear_state_.IsCleared(x, y)) return clear_value_;
     return data_[x + y * width_];
 }
 
 void DepthBuffer::Clear(const float value) const {
-    std::fill_n(data_.get(), width_ * height_, value);
+    clear_value_ = value;
+    clear_state_.MarkAll();
+}
+
+void DepthBuffer::Resolve() const {
+    clear_state_.Resolve([this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
+}
+
+void DepthBuffer::FillRect(const size_t x0, const size_t x1, const size_t y0, const size_t y1) const {
+    for (size_t y = y0; y < y1; ++y)
+        std::fill_n(data_.get() + y * width_ + x0, x1 - x0, clear_value_);
+}
+
+// MultisampleBuffer
+MultisampleBuffer::MultisampleBuffer(const size_t width, const size_t height, const size_t samples)
+    : width_(width), height_(height), samples_(samples),
+      pixels_(std::make_unique<Pixel[]>(width * height)), depths_(std::make_unique<float[]>(width * height * samples)),
+      clear_state_(width, height) {
+    assert(GetSamplePositions(samples) != nullptr);
+    Clear();
+}
+
+const Vector2f* MultisampleBuffer::GetSamplePositions(const size_t samples) {
+    // the usual hardware patterns on a 1/16 pixel grid, no two samples share a row or a column
+    static const Vector2f kOne[] = {{0, 0}};
+    static const Vector2f kTwo[] = {{0.25f, 0.25f}, {-0.25f, -0.25f}};
+    static const Vector2f kFour[] = {{-0.125f, -0.375f}, {0.375f, -0.125f}, {-0.375f, 0.125f}, {0.125f, 0.375f}};
+    static const Vector2f kEight[] = {
+        {0.0625f, -0.1875f}, {-0.0625f, 0.1875f}, {0.3125f, 0.0625f}, {-0.1875f, -0.3125f},
+        {-0.3125f, 0.3125f}, {-0.4375f, -0.0625f}, {0.1875f, 0.4375f}, {0.4375f, -0.4375f}
+    };
+    switch (samples) {
+        case 1: return kOne;
+        case 2: return kTwo;
+        case 4: return kFour;
+        case 8: return kEight;
+        default: return nullptr;
+    }
+}
+
+MultisampleBuffer::Pixel* MultisampleBuffer::pixel(const size_t x, const size_t y) const {
+    assert(x < width_ && y < height_);
+    clear_state_.Materialize(x, y, [this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
+    return pixels_.get() + y * width_ + x;
+}
+
+float* MultisampleBuffer::depths(const size_t x, const size_t y) const {
+    assert(x < width_ && y < height_);
+    clear_state_.Materialize(x, y, [this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
+    return depths_.get() + (y * width_ + x) * samples_;
+}
+
+void MultisampleBuffer::Clear(const uint8_t color, const float depth) const {
+    clear_color_ = color;
+    clear_depth_ = depth;
+    clear_state_.MarkAll();
+}
+
+void MultisampleBuffer::Resolve() const {
+    clear_state_.Resolve([this](const size_t x0, const size_t x1, const size_t y0, const size_t y1) { FillRect(x0, x1, y0, y1); });
+}
+
+void MultisampleBuffer::FillRect(const size_t x0, const size_t x1, const size_t y0, const size_t y1) const {
+    const Color color {clear_color_, clear_color_, clear_color_, clear_color_};
+    const Pixel pixel {.palette = {color, color}, .mask = 0, .known = 0xff};
+    for (size_t y = y0; y < y1; ++y) {
+        std::fill_n(pixels_.get() + y * width_ + x0, x1 - x0, pixel);
+        std::fill_n(depths_.get() + (y * width_ + x0) * samples_, (x1 - x0) * samples_, clear_depth_);
+    }
+}
+
+void MultisampleBuffer::Pixel::Write(const std::uint32_t written, const Color &color, const size_t samples) {
+    const std::uint32_t kept = ((1u << samples) - 1) & known & ~written;
+    const std::uint32_t kept_first = kept & ~mask, kept_second = kept & mask;
+    if (kept_second == 0 || (kept_first != 0 && std::popcount(kept_first) >= std::popcount(kept_second))) {
+        palette[1] = color;
+        mask = static_cast<std::uint8_t>(written);
+        known = static_cast<std::uint8_t>(kept_first | written);
+    } else {
+        palette[0] = color;
+        mask = static_cast<std::uint8_t>(kept_second);
+        known = static_cast<std::uint8_t>(kept_second | written);
+    }
+}
+
+Color MultisampleBuffer::Pixel::Resolve(const size_t samples) const {
+    const std::uint32_t all = (1u << samples) - 1;
+    const int second = std::popcount(static_cast<std::uint32_t>(mask & known)), first = std::popcount(~mask & known & all);
+    if (second == 0 || palette[0] == palette[1]) return palette[0];
+    if (first == 0) return palette[1];
+    const int count = first + second;
+    Color color;
+    for (int c = 0; c < 4; ++c)
+        color[c] = static_cast<std::uint8_t>((palette[0][c] * first + palette[1][c] * second + count / 2) / count);
+    return color;
 }
 
 // FrameBuffer
-FrameBuffer::FrameBuffer(const size_t width, const size_t height, const uint8_t bpp)
-    : color_buffer(width, height, bpp), depth_buffer(width, height) {}
+FrameBuffer::FrameBuffer(const size_t width, const size_t height, const uint8_t bpp, const size_t samples)
+    : color_buffer(width, height, bpp), depth_buffer(width, height), render_width_(width), render_height_(height) {
+    SetSampleCount(samples);
+}
 
 void FrameBuffer::Clear(const uint8_t default_color, const float default_depth) const {
     color_buffer.Clear(default_color);
     depth_buffer.Clear(default_depth);
+    if (multisample != nullptr) multisample->Clear(default_color, default_depth);
+}
+
+void FrameBuffer::Resolve() const {
+    color_buffer.Resolve();
+    depth_buffer.Resolve();
+    if (multisample != nullptr) multisample->Resolve();
+}
+
+void FrameBuffer::SetSampleCount(const size_t samples) {
+    if (samples == this->samples()) return;
+    if (samples <= 1) multisample.reset();
+    else multisample = std::make_unique<MultisampleBuffer>(width(), height(), samples);
+}
+
+void FrameBuffer::SetRenderSize(const size_t width, const size_t height) {
+    assert(width > 0 && height > 0);
+    render_width_ = std::min(width, this->width());
+    render_height_ = std::min(height, this->height());
 }
 
 Matrix4x4 FrameBuffer::GetViewportMatrix() const {
-    return GetViewportMatrix(0, 0, width(), height());
+    return GetViewportMatrix(0, 0, render_width_, render_height_);
 }
 
 Matrix4x4 FrameBuffer::GetViewportMatrix(const size_t x, const size_t y, const size_t w, const size_t h) {
@@ -0,0 +1,62 @@
+#include "command_buffer.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+    // returns a small id for a pointer, in order of first appearance
+    template<typename T>
+    std::uint64_t GetId(std::vector<const T*> &ids, const T *ptr) {
+        const auto it = std::find(ids.begin(), ids.end(), ptr);
+        if (it != ids.end()) return it - ids.begin();
+        ids.push_back(ptr);
+        return ids.size() - 1;
+    }
+}
+
+void CommandBuffer::Record(const std::shared_ptr<const Model> &model, const std::shared_ptr<const IShader> &shader, const Matrix4x4 &model_matrix) {
+    commands_.push_back({.model = model, .shader = shader, .model_matrix = model_matrix, .order = static_cast<std::uint32_t>(commands_.size())});
+    sorted_ = false;
+}
+
+void CommandBuffer::Clear() {
+    commands_.clear();
+    sorted_ = false;
+}
+
+void CommandBuffer::Sort(const Matrix4x4 &view_matrix) {
+    if (sorted_) {
+        bool same_view = true;
+        for (size_t i = 0; i < 4 && same_view; ++i)
+            for (size_t j = 0; j < 4 && same_view; ++j)
+                same_view = sorted_view_matrix_[i][j] == view_matrix[i][j];
+        if (same_view) return;
+    }
+
+    // key layout: shader id (16 bits) | material id (16 bits) | view depth (32 bits)
+    shader_ids_.clear();
+    model_ids_.clear();
+    for (auto &command : commands_) {
+        const Vector4f origin_view_space = view_matrix * command.model_matrix.Col(3);
+        const float depth = std::max(0.0f, -origin_view_space[2]); // the camera looks down -z
+        command.sort_key = (GetId(shader_ids_, command.shader.get()) & 0xffff) << 48 |
+                           (GetId(model_ids_, command.model.get()) & 0xffff) << 32 |
+                           std::bit_cast<std::uint32_t>(depth); // non-negative floats sort like their bits
+    }
+    // ties keep their recording order, like a stable sort but without its temporary buffer
+    std::sort(commands_.begin(), commands_.end(), [](const DrawCommand &a, const DrawCommand &b) {
+        return a.sort_key != b.sort_key ? a.sort_key < b.sort_key : a.order < b.order;
+    });
+    sorted_view_matrix_ = view_matrix;
+    sorted_ = true;
+}
+
+void CommandBuffer::Build(const std::shared_ptr<const FrameState> &frame, ArenaVector<DrawState> &draws) const {
+    // consecutive commands sharing shader and model are merged into one instanced draw
+    const size_t first_draw = draws.size();
+    for (const auto &command : commands_) {
+        if (command.model == nullptr || command.shader == nullptr) continue;
+        if (draws.size() == first_draw || draws.back().model != command.model || draws.back().shader != command.shader)
+            draws.push_back({.frame = frame, .shader = command.shader, .model = command.model, .instances = ArenaVector<InstanceTransform>(draws.get_allocator())});
+        draws.back().instances.push_back(InstanceTransform::Create(command.model_matrix, frame->view_matrix));
+    }
+}
@@ -1,9 +1,12 @@
 #include "component-gameobject.h"
 
+#include <algorithm>
 #include <utility/log.h>
+#include <utility/thread_pool.h>
 
-Matrix4x4 Transform::GetModelMatrix() const {
-    const Vector3f radian = rotation * M_PI / 180.0;
+const Matrix4x4& Transform::GetModelMatrix() const {
+    if (!dirty_) return local_matrix_;
+    const Vector3f radian = rotation_ * M_PI / 180.0;
     const Matrix4x4 rotate_x {
         {1, 0, 0, 0},
         {0, std::cos(radian[0]), -std::sin(radian[0]), 0},
@@ -24,19 +27,87 @@ Matrix4x4 Transform::GetModelMatrix() const {
     };
     const Matrix4x4 rotation_mat = rotate_z * rotate_x * rotate_y;
     const Matrix4x4 scale_mat {
-        {scale[0], 0, 0, 0},
-        {0, scale[1], 0, 0},
-        {0, 0, scale[2], 0},
+        {scale_[0], 0, 0, 0},
+        {0, scale_[1], 0, 0},
+        {0, 0, scale_[2], 0},
         {0, 0, 0, 1}
     };
     const Matrix4x4 translate_mat {
-        {1, 0, 0, position[0]},
-        {0, 1, 0, position[1]},
-        {0, 0, 1, position[2]},
+        {1, 0, 0, position_[0]},
+        {0, 1, 0, position_[1]},
+        {0, 0, 1, position_[2]},
         {0, 0, 0, 1}
     };
 
-    return translate_mat * rotation_mat * scale_mat;
+    local_matrix_ = translate_mat * rotation_mat * scale_mat;
+    dirty_ = false;
+    return local_matrix_;
+}
+
+const Matrix4x4& GameObject::GetModelMatrix() const {
+    if (IsWorldDirty()) UpdateWorldMatrix();
+    return world_matrix_;
+}
+
+void GameObject::AddChild(const std::shared_ptr<GameObject>& child) {
+    if (child == nullptr || child.get() == this) return;
+    if (child->parent_ != nullptr) {
+        LOG_WARNING("GameObject - " + child->name + " already has a parent, detaching it first");
+        child->parent_->RemoveChild(child);
+    }
+    child->parent_ = this;
+    children_.push_back(child);
+    child->MarkDirty();
+}
+
+void GameObject::RemoveChild(const std::shared_ptr<GameObject>& child) {
+    const auto it = std::find(children_.begin(), children_.end(), child);
+    if (it == children_.end()) return;
+    (*it)->parent_ = nullptr;
+    (*it)->MarkDirty();
+    children_.erase(it);
+}
+
+void GameObject::UpdateHierarchy(const std::span<GameObject* const> roots, FrameArena* arena) {
+    ArenaVector<GameObject*> level{ArenaAllocator<GameObject*>(arena)};
+    for (GameObject* root : roots)
+        if (root != nullptr && root->subtree_dirty_) level.push_back(root);
+
+    ArenaVector<GameObject*> next_level{ArenaAllocator<GameObject*>(arena)};
+    while (!level.empty()) {
+        // parents have been resolved by the previous level, so siblings and cousins are independent
+        ThreadPool::Instance().ParallelFor(0, level.size(), [&level](const size_t i) {
+            if (level[i]->world_dirty_) level[i]->UpdateWorldMatrix();
+        });
+        next_level.clear();
+        for (GameObject* node : level) {
+            for (const auto& child : node->children_)
+                if (child->subtree_dirty_ || child->world_dirty_) next_level.push_back(child.get());
+            node->subtree_dirty_ = false;
+        }
+        level.swap(next_level);
+    }
+}
+
+void GameObject::MarkDirty() {
+    world_dirty_ = true;
+    subtree_dirty_ = true;
+    // propagate upwards until an ancestor that is already known to hold a stale subtree
+    for (GameObject* node = parent_; node != nullptr && !node->subtree_dirty_; node = node->parent_)
+        node->subtree_dirty_ = true;
+}
+
+void GameObject::UpdateWorldMatrix() const {
+    world_matrix_ = parent_ != nullptr ? parent_->GetModelMatrix() * transform.GetModelMatrix() : transform.GetModelMatrix();
+    world_dirty_ = false;
+    // children depend on this world matrix, invalidate them (each child is owned by exactly one parent)
+    for (const auto& child : children_) child->world_dirty_ = true;
+}
+
+bool GameObject::IsWorldDirty() const {
+    for (const GameObject* node = this; node != nullptr; node = node->parent_)
+        if (node->world_dirty_) return true;
+    return false;
 }
 
 Matrix4x4 Camera::GetProjectionMatrix() const {
@@ -63,14 +134,16 @@ Matrix4x4 Camera::GetProjectionMatrix() const {
 }
 
 Matrix4x4 CameraObject::GetViewMatrix() const {
+    // position and axes in world space, the up axis follows the parent so that a tilted parent tilts the camera
+    const Matrix4x4& world = GetModelMatrix();
     Vector3f forward = GetViewDirection();
-    Vector3f up = {0, 1, 0};
+    Vector3f up = parent() != nullptr ? (parent()->GetModelMatrix() * Vector4f {0, 1, 0, 0}).Project<3>().Normalize() : Vector3f {0, 1, 0};
     Vector3f right = up.Cross(forward).Normalize();
 
     const Matrix4x4 translate_mat {
-        {1, 0, 0, -transform.position[0]},
-        {0, 1, 0, -transform.position[1]},
-        {0, 0, 1, -transform.position[2]},
+        {1, 0, 0, -world[0][3]},
+        {0, 1, 0, -world[1][3]},
+        {0, 0, 1, -world[2][3]},
         {0, 0, 0, 1}
     };
 
@@ -85,7 +158,7 @@ Matrix4x4 CameraObject::GetViewMatrix() const {
 }
 
 Vector3f CameraObject::GetViewDirection() const {
-    const Vector3f rotation = transform.rotation * M_PI / 180.0f;
+    const Vector3f rotation = transform.rotation() * M_PI / 180.0f;
     const Matrix3x3 rotate_x {
         {1, 0, 0},
         {0, std::cos(rotation[0]), -std::sin(rotation[0])},
@@ -102,5 +175,7 @@ Vector3f CameraObject::GetViewDirection() const {
         {0, 0, 1}
     };
     const Matrix3x3 rotation_mat = rotate_z * rotate_x * rotate_y;
-    return (rotation_mat * Vector3f {0, 0, -1}).Normalize();
+    const Vector3f direction = (rotation_mat * Vector3f {0, 0, -1}).Normalize();
+    if (parent() == nullptr) return direction;
+    return (parent()->GetModelMatrix() * direction.Embed<4>(0)).Project<3>().Normalize();
 }
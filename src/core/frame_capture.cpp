@@ -0,0 +1,169 @@
+#include "frame_capture.h"
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include "utility/log.h"
+#include "utility/profiler.h"
+#include "tga_handler.h"
+
+FrameSnapshot::FrameSnapshot(const size_t width, const size_t height, const bool with_depth, const bool with_normal)
+    : color(width, height, RGBA) {
+    if (with_depth) depth = std::make_unique<float[]>(width * height);
+    if (with_normal) normal = std::make_unique<float[]>(width * height * 3);
+}
+
+FrameCapture::FrameCapture(const size_t width, const size_t height, const size_t pool_size, const CapturePolicy policy,
+                           std::string output_pattern, const bool capture_depth, const bool capture_normal, const bool rle)
+    : width_(width), height_(height), policy_(policy), output_pattern_(std::move(output_pattern)), rle_(rle) {
+    snapshots_.reserve(std::max<size_t>(1, pool_size));
+    for (size_t i = 0; i < std::max<size_t>(1, pool_size); ++i) {
+        snapshots_.push_back(std::make_unique<FrameSnapshot>(width, height, capture_depth, capture_normal));
+        free_queue_.push(snapshots_.back().get());
+    }
+    std::error_code error;
+    if (const auto directory = std::filesystem::path(output_pattern_).parent_path(); !directory.empty())
+        std::filesystem::create_directories(directory, error);
+    if (error) LOG_WARNING("FrameCapture - cannot create the output directory: " + error.message());
+    write_thread_ = std::thread([this] { WriteLoop(); });
+    LOG_INFO("FrameCapture - " + std::to_string(snapshots_.size()) + " snapshot(s), " +
+             (policy_ == CAPTURE_BLOCK ? "blocking" : "dropping") + " when full, writing to " + output_pattern_);
+}
+
+FrameCapture::~FrameCapture() {
+    Flush();
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    if (write_thread_.joinable()) write_thread_.join();
+    LOG_INFO("FrameCapture - " + std::to_string(written_) + " frame(s) written, " + std::to_string(dropped_) + " dropped, " +
+             std::to_string(failed_) + " failed");
+}
+
+bool FrameCapture::Capture(const FrameBuffer &frame_buffer, const GBuffer *g_buffer) {
+    PROFILE_SCOPE(Capture);
+    if (frame_buffer.width() != width_ || frame_buffer.height() != height_) {
+        LOG_ERROR("FrameCapture - frame size does not match the snapshot size");
+        return false;
+    }
+    FrameSnapshot* snapshot;
+    {
+        std::unique_lock lock(mutex_);
+        if (free_queue_.empty() && policy_ == CAPTURE_DROP) {
+            frame_count_++;
+            dropped_++;
+            return false;
+        }
+        condition_.wait(lock, [this] { return !free_queue_.empty(); });
+        snapshot = free_queue_.front();
+        free_queue_.pop();
+        snapshot->frame_index = frame_count_++;
+    }
+
+    // the frame belongs to the caller until it is submitted, so the copy needs no lock
+    const ColorBuffer &color = frame_buffer.color_buffer;
+    if (color.bpp() == RGBA) {
+        color.CopyTo(snapshot->color.data());
+    } else {
+        for (size_t y = 0; y < height_; ++y)
+            for (size_t x = 0; x < width_; ++x)
+                snapshot->color.SetPixel(x, y, color.GetPixel(x, y));
+    }
+    snapshot->has_depth = snapshot->depth != nullptr;
+    if (snapshot->has_depth)
+        std::copy_n(frame_buffer.depth_buffer.data(), frame_buffer.depth_buffer.size(), snapshot->depth.get());
+    snapshot->has_normal = snapshot->normal != nullptr && g_buffer != nullptr;
+    if (snapshot->has_normal)
+        std::copy_n(g_buffer->normal.data(), g_buffer->normal.size(), snapshot->normal.get());
+    captured_++;
+
+    {
+        std::lock_guard lock(mutex_);
+        write_queue_.push(snapshot);
+    }
+    condition_.notify_all();
+    return true;
+}
+
+void FrameCapture::Flush() {
+    std::unique_lock lock(mutex_);
+    condition_.wait(lock, [this] { return write_queue_.empty(); });
+}
+
+void FrameCapture::WriteLoop() {
+    while (true) {
+        FrameSnapshot* snapshot;
+        {
+            std::unique_lock lock(mutex_);
+            condition_.wait(lock, [this] { return stop_ || !write_queue_.empty(); });
+            if (write_queue_.empty()) return;
+            snapshot = write_queue_.front();
+        }
+        {
+            PROFILE_SCOPE(CaptureWrite);
+            if (Write(*snapshot)) written_++;
+            else failed_++;
+        }
+        {
+            std::lock_guard lock(mutex_);
+            write_queue_.pop();
+            free_queue_.push(snapshot);
+        }
+        condition_.notify_all();
+    }
+}
+
+bool FrameCapture::Write(const FrameSnapshot &snapshot) const {
+    const int width = static_cast<int>(width_), height = static_cast<int>(height_);
+    bool written = TGAHandler::WriteTGAFile(GetOutputPath(snapshot.frame_index), snapshot.color, false, rle_);
+
+    if (snapshot.has_depth) {
+        // nearest depth is white, farthest and uncovered pixels are black
+        const size_t count = width_ * height_;
+        float nearest = std::numeric_limits<float>::max(), farthest = std::numeric_limits<float>::lowest();
+        for (size_t i = 0; i < count; ++i) {
+            const float depth = snapshot.depth[i];
+            if (depth == std::numeric_limits<float>::max()) continue;
+            nearest = std::min(nearest, depth);
+            farthest = std::max(farthest, depth);
+        }
+        const float scale = farthest > nearest ? 255.0f / (farthest - nearest) : 0.0f;
+        std::vector<std::uint8_t> gray(count, 0);
+        for (size_t i = 0; i < count; ++i) {
+            const float depth = snapshot.depth[i];
+            if (depth == std::numeric_limits<float>::max()) continue;
+            gray[i] = static_cast<std::uint8_t>(255.0f - (depth - nearest) * scale);
+        }
+        written &= TGAHandler::WriteTGAFile(GetOutputPath(snapshot.frame_index, "_depth"), width, height, GRAYSCALE, gray.data(), false, rle_);
+    }
+
+    if (snapshot.has_normal) {
+        // n * 0.5 + 0.5 per channel, stored as bgr
+        const size_t count = width_ * height_;
+        std::vector<std::uint8_t> bgr(count * RGB);
+        const auto to_byte = [](const float v) { return static_cast<std::uint8_t>(std::clamp(v * 0.5f + 0.5f, 0.0f, 1.0f) * 255.0f); };
+        for (size_t i = 0; i < count; ++i) {
+            bgr[i * 3 + 0] = to_byte(snapshot.normal[i * 3 + 2]);
+            bgr[i * 3 + 1] = to_byte(snapshot.normal[i * 3 + 1]);
+            bgr[i * 3 + 2] = to_byte(snapshot.normal[i * 3 + 0]);
+        }
+        written &= TGAHandler::WriteTGAFile(GetOutputPath(snapshot.frame_index, "_normal"), width, height, RGB, bgr.data(), false, rle_);
+    }
+    if (!written) LOG_ERROR("FrameCapture - failed to write frame " + std::to_string(snapshot.frame_index));
+    return written;
+}
+
+std::string FrameCapture::GetOutputPath(const size_t frame_index, const std::string &suffix) const {
+    std::string path = output_pattern_;
+    if (const size_t first = path.find('#'); first != std::string::npos) {
+        const size_t last = std::min(path.find_first_not_of('#', first), path.size());
+        std::string index = std::to_string(frame_index);
+        if (index.size() < last - first) index.insert(0, last - first - index.size(), '0');
+        path.replace(first, last - first, index);
+    }
+    const size_t dot = path.find_last_of('.');
+    const size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + suffix;
+    return path.insert(dot, suffix);
+}
@@ -0,0 +1,103 @@
+#include "frame_pipeline.h"
+#include "utility/log.h"
+#include "utility/profiler.h"
+
+FramePipeline::FramePipeline(const size_t width, const size_t height, const size_t queue_depth)
+    : slots_(std::max<size_t>(1, queue_depth)) {
+    free_queue_.Reserve(slots_.size());
+    resolve_queue_.Reserve(slots_.size());
+    present_queue_.Reserve(slots_.size());
+    clear_queue_.Reserve(slots_.size());
+    for (auto& slot : slots_) {
+        slot.frame_buffer = std::make_shared<FrameBuffer>(width, height, RGBA);
+        slot.g_buffer = std::make_shared<GBuffer>(width, height);
+        free_queue_.push(&slot);
+    }
+    if (slots_.size() > 1) worker_thread_ = std::thread([this] { WorkerLoop(); });
+    LOG_INFO("FramePipeline - " + std::to_string(slots_.size()) + " frame(s) in flight");
+}
+
+FramePipeline::~FramePipeline() {
+    Close();
+    if (worker_thread_.joinable()) worker_thread_.join();
+}
+
+FrameSlot* FramePipeline::AcquireFrame() {
+    std::unique_lock lock(mutex_);
+    condition_.wait(lock, [this] { return stop_ || !free_queue_.empty(); });
+    if (stop_) return nullptr;
+    FrameSlot* slot = free_queue_.front();
+    free_queue_.pop();
+    slot->frame_index = frame_count_++;
+    return slot;
+}
+
+void FramePipeline::SubmitFrame(FrameSlot &slot) {
+    if (slots_.size() == 1) Resolve(slot);
+    {
+        std::lock_guard lock(mutex_);
+        (slots_.size() == 1 ? present_queue_ : resolve_queue_).push(&slot);
+    }
+    condition_.notify_all();
+}
+
+FrameSlot* FramePipeline::AcquirePresent() {
+    std::unique_lock lock(mutex_);
+    condition_.wait(lock, [this] { return stop_ || !present_queue_.empty(); });
+    if (stop_) return nullptr;
+    FrameSlot* slot = present_queue_.front();
+    present_queue_.pop();
+    return slot;
+}
+
+void FramePipeline::ReleasePresent(FrameSlot &slot) {
+    if (slots_.size() == 1) Clear(slot);
+    {
+        std::lock_guard lock(mutex_);
+        (slots_.size() == 1 ? free_queue_ : clear_queue_).push(&slot);
+    }
+    condition_.notify_all();
+}
+
+void FramePipeline::Close() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+}
+
+void FramePipeline::Resolve(const FrameSlot &slot) {
+    PROFILE_SCOPE(ClearResolve);
+    slot.frame_buffer->color_buffer.Resolve();
+}
+
+void FramePipeline::Clear(const FrameSlot &slot) {
+    PROFILE_SCOPE(Clear);
+    slot.frame_buffer->Clear();
+    slot.g_buffer->Clear();
+}
+
+void FramePipeline::WorkerLoop() {
+    while (true) {
+        FrameSlot* slot;
+        bool resolve;
+        {
+            std::unique_lock lock(mutex_);
+            condition_.wait(lock, [this] { return stop_ || !resolve_queue_.empty() || !clear_queue_.empty(); });
+            if (stop_) return;
+            // frames waiting to be shown go first, a clear only has to be done before the next free slot is needed
+            resolve = !resolve_queue_.empty();
+            SlotQueue &queue = resolve ? resolve_queue_ : clear_queue_;
+            slot = queue.front();
+            queue.pop();
+        }
+        if (resolve) Resolve(*slot);
+        else Clear(*slot);
+        {
+            std::lock_guard lock(mutex_);
+            (resolve ? present_queue_ : free_queue_).push(slot);
+        }
+        condition_.notify_all();
+    }
+}
@@ -1,50 +1,66 @@
 #include "ishader.h"
 
 #include <utility/log.h>
+#include <utility/profiler.h>
+#include <utility/thread_pool.h>
 
-void IShader::NormalizeLights() {
+void FrameState::NormalizeLights() {
     for (auto& [direction, intensity] : lights) {
         direction = direction.Normalize();
         intensity = intensity.Normalize();
     }
 }
 
-void IShader::Deferred(const GBuffer &g_buffer, const FrameBuffer &frame_buffer) const {
-#pragma omp parallel for
-    for (const auto& [direction, intensity] : lights) {
-        for (int x = 0; x < frame_buffer.width(); ++x) {
-            for (int y = 0; y < frame_buffer.height(); ++y) {
+void IShader::Deferred(const FrameState &frame, const GBuffer &g_buffer, const FrameBuffer &frame_buffer) const {
+    // each task owns one row of buffer tiles, so lazily cleared tiles are never filled by two threads
+    constexpr size_t kBand = TileClearState::kTileSize;
+    const size_t bands = (frame_buffer.render_height() + kBand - 1) / kBand;
+    ThreadPool::Instance().ParallelFor(0, bands, [&](const size_t band) {
+        PROFILE_SCOPE(DeferredResolve);
+        for (size_t y = band * kBand; y < std::min((band + 1) * kBand, frame_buffer.render_height()); ++y) {
+            for (int x = 0; x < frame_buffer.render_width(); ++x) {
                 Color color = frame_buffer.color_buffer.GetPixel(x, y);
                 if (color[0] == 0 && color[1] == 0 && color[2] == 0) continue;
 
                 const Vector3f normal = g_buffer.normal.Get(x, y);
                 if (normal[0] == 0 && normal[1] == 0 && normal[2] == 0) continue;
 
-                const float diffuse = std::max(0.0f, normal * direction);
-                const Vector3f half = (direction + view_direction).Normalize() * -1;
-                const float specular = static_cast<float>(std::pow(std::max(0.0f, normal * half), 120));
-                color = color * (diffuse + specular + ambient_light + 0.5f);
+                for (const auto& [direction, intensity] : frame.lights) {
+                    const float diffuse = std::max(0.0f, normal * direction);
+                    const Vector3f half = (direction + frame.view_direction).Normalize() * -1;
+                    const float specular = static_cast<float>(std::pow(std::max(0.0f, normal * half), 120));
+                    color = color * (diffuse + specular + ambient_light + 0.5f);
+                }
                 frame_buffer.color_buffer.SetPixel(x, y, color);
             }
         }
-    }
+    });
+}
+
+InstanceTransform InstanceTransform::Create(const Matrix4x4 &model_matrix, const Matrix4x4 &view_matrix) {
+    InstanceTransform instance;
+    instance.model_matrix = model_matrix;
+    instance.model_view_matrix = view_matrix * model_matrix;
+    instance.normal_matrix = instance.model_view_matrix.InverseTranspose();
+    return instance;
 }
 
 void StandardVertexShader::VertexShader(const VertexShaderInput &in, Vertex &out) const {
     out.uv = in.uv;
-    out.normal = ((view_matrix * model_matrix).InverseTranspose() * in.normal.Embed<4>(0)).Project<3>();
+    out.normal = (in.instance.normal_matrix * in.normal.Embed<4>(0)).Project<3>();
     out.vertex_model_space = in.vertex_model_space;
-    out.vertex_view_space = (view_matrix * model_matrix * in.vertex_model_space.Embed<4>(1)).Project<3>();
-    out.vertex_clip_space = projection_matrix * out.vertex_view_space.Embed<4>(1);
+    out.vertex_view_space = (in.instance.model_view_matrix * in.vertex_model_space.Embed<4>(1)).Project<3>();
+    out.vertex_clip_space = in.state.frame->projection_matrix * out.vertex_view_space.Embed<4>(1);
     out.vertex_ndc_space = out.vertex_clip_space / out.vertex_clip_space[3];
-    out.vertex_screen_space = (viewport_matrix * out.vertex_clip_space / out.vertex_clip_space[3]).Project<2>();
+    out.vertex_screen_space = (in.state.frame->viewport_matrix * out.vertex_clip_space / out.vertex_clip_space[3]).Project<2>();
 }
 
 bool FixedShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &out) const {
+    const FrameState &frame = *in.state.frame;
     const Vector3f interpolated_normal = Interpolate(in.triangle[0].normal, in.triangle[1].normal, in.triangle[2].normal, in.bc_clip).Normalize();
 
     float lightness = 0.0;
-    for (const auto& [direction, intensity] : lights) {
+    for (const auto& [direction, intensity] : frame.lights) {
         lightness += std::max(0.0f, interpolated_normal * direction);
     }
     if (lightness > 0.85)       out.color = Color{255, 255, 255, 255} * 1;
@@ -57,10 +73,11 @@ bool FixedShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &
 }
 
 bool GrayShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &out) const {
+    const FrameState &frame = *in.state.frame;
     const Vector3f interpolated_normal = Interpolate(in.triangle[0].normal, in.triangle[1].normal, in.triangle[2].normal, in.bc_clip);
 
     float lightness = 0.0;
-    for (const auto& [direction, intensity] : lights) {
+    for (const auto& [direction, intensity] : frame.lights) {
         lightness += std::max(0.0f, interpolated_normal * direction);
     }
     out.color = Color{255, 255, 255, 255} * lightness;
@@ -68,16 +85,18 @@ bool GrayShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &o
 }
 
 bool PhongShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &out) const {
+    const Model &model = *in.state.model;
+    const FrameState &frame = *in.state.frame;
     const Vector3f interpolated_normal = Interpolate(in.triangle[0].normal, in.triangle[1].normal, in.triangle[2].normal, in.bc_clip).Normalize();
     const Vector2f interpolated_uv = Interpolate(in.triangle[0].uv, in.triangle[1].uv, in.triangle[2].uv, in.bc_clip);
-    const Color texture_color = model->diffuse_map() != nullptr ? model->diffuse_map()->GetPixel(interpolated_uv) : Color::White();
-    const Color specular_color = model->specular_map() != nullptr ? model->specular_map()->GetPixel(interpolated_uv) : Color::White();
+    const Color texture_color = model.diffuse_map() != nullptr ? model.diffuse_map()->GetPixel(interpolated_uv) : Color::White();
+    const Color specular_color = model.specular_map() != nullptr ? model.specular_map()->GetPixel(interpolated_uv) : Color::White();
 
     float lightness = 0.0;
-    for (const auto& [direction, intensity] : lights) {
+    for (const auto& [direction, intensity] : frame.lights) {
         const float diffuse = std::max(0.0f, interpolated_normal * direction);
         Vector3f reflection = (interpolated_normal * (interpolated_normal * direction) * 2 - direction).Normalize();
-        const float specular = static_cast<float>(std::pow(std::max(0.0f, reflection * view_direction), specular_color[0] + 5));
+        const float specular = static_cast<float>(std::pow(std::max(0.0f, reflection * frame.view_direction), specular_color[0] + 5));
         lightness += diffuse + specular;
     }
     lightness += ambient_light;
@@ -86,15 +105,17 @@ bool PhongShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &
 }
 
 bool BlinnPhongShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &out) const {
+    const Model &model = *in.state.model;
+    const FrameState &frame = *in.state.frame;
     const Vector3f interpolated_normal = Interpolate(in.triangle[0].normal, in.triangle[1].normal, in.triangle[2].normal, in.bc_clip).Normalize();
     const Vector2f interpolated_uv = Interpolate(in.triangle[0].uv, in.triangle[1].uv, in.triangle[2].uv, in.bc_clip);
-    const Color texture_color = model->diffuse_map() != nullptr ? model->diffuse_map()->GetPixel(interpolated_uv) : Color::White();
-    const Color specular_color = model->specular_map() != nullptr ? model->specular_map()->GetPixel(interpolated_uv) : Color::White();
+    const Color texture_color = model.diffuse_map() != nullptr ? model.diffuse_map()->GetPixel(interpolated_uv) : Color::White();
+    const Color specular_color = model.specular_map() != nullptr ? model.specular_map()->GetPixel(interpolated_uv) : Color::White();
 
     float lightness = 0.0;
-    for (const auto& [direction, intensity] : lights) {
+    for (const auto& [direction, intensity] : frame.lights) {
         const float diffuse = std::max(0.0f, interpolated_normal * direction);
-        const Vector3f half = (direction + view_direction).Normalize() * -1;
+        const Vector3f half = (direction + frame.view_direction).Normalize() * -1;
         const float specular = static_cast<float>(std::pow(std::max(0.0f, interpolated_normal * half), specular_color[0] + 100));
         lightness += diffuse + specular;
     }
@@ -104,12 +125,15 @@ bool BlinnPhongShader::Fragment(const FragmentShaderInput &in, FragmentShaderOut
 }
 
 bool NormalShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &out) const {
+    const Model &model = *in.state.model;
+    const FrameState &frame = *in.state.frame;
     const Vector2f interpolated_uv = Interpolate(in.triangle[0].uv, in.triangle[1].uv, in.triangle[2].uv, in.bc_clip);
-    const Vector3f normal = model->normal(interpolated_uv).Normalize() ;
-    const Color texture_color = model->diffuse_map() != nullptr ? model->diffuse_map()->GetPixel(interpolated_uv) : Color::White();
+    const Vector3f normal = model.normal_map() != nullptr ? model.normal(interpolated_uv).Normalize()
+                                                          : Interpolate(in.triangle[0].normal, in.triangle[1].normal, in.triangle[2].normal, in.bc_clip).Normalize();
+    const Color texture_color = model.diffuse_map() != nullptr ? model.diffuse_map()->GetPixel(interpolated_uv) : Color::White();
 
     float lightness = 0.0;
-    for (const auto& [direction, intensity] : lights) {
+    for (const auto& [direction, intensity] : frame.lights) {
         lightness += std::max(0.0f, normal * direction);
     }
     out.color = texture_color * lightness;
@@ -117,11 +141,13 @@ bool NormalShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput
 }
 
 bool NormalTangentShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &out) const {
+    const Model &model = *in.state.model;
+    const FrameState &frame = *in.state.frame;
     const Vector3f interpolated_normal = Interpolate(in.triangle[0].normal, in.triangle[1].normal, in.triangle[2].normal, in.bc_clip).Normalize();
     const Vector2f interpolated_uv = Interpolate(in.triangle[0].uv, in.triangle[1].uv, in.triangle[2].uv, in.bc_clip);
-    const Vector3f normal_tangent = model->normal_map_tangent() != nullptr ? model->normal_tangent(interpolated_uv) : interpolated_normal;
-    const Color texture_color = model->diffuse_map() != nullptr ? model->diffuse_map()->GetPixel(interpolated_uv) : Color::White();
-    const Color specular_color = model->specular_map() != nullptr ? model->specular_map()->GetPixel(interpolated_uv) : Color::White();
+    const Vector3f normal_tangent = model.normal_map_tangent() != nullptr ? model.normal_tangent(interpolated_uv) : interpolated_normal;
+    const Color texture_color = model.diffuse_map() != nullptr ? model.diffuse_map()->GetPixel(interpolated_uv) : Color::White();
+    const Color specular_color = model.specular_map() != nullptr ? model.specular_map()->GetPixel(interpolated_uv) : Color::White();
 
     const Matrix3x3 A_inverse = Matrix3x3 {
         (in.triangle[1].vertex_ndc_space - in.triangle[0].vertex_ndc_space).Project<3>(),
@@ -146,9 +172,9 @@ bool NormalTangentShader::Fragment(const FragmentShaderInput &in, FragmentShader
     const Vector3f normal_mapping = (TBN * normal_tangent).Normalize();
 
     float lightness = 0.0;
-    for (const auto& [direction, intensity] : lights) {
+    for (const auto& [direction, intensity] : frame.lights) {
         const float diffuse = std::max(0.0f, normal_mapping * direction);
-        const Vector3f half = (direction + view_direction).Normalize() * -1;
+        const Vector3f half = (direction + frame.view_direction).Normalize() * -1;
         const float specular = static_cast<float>(std::pow(std::max(0.0f, normal_mapping * half), specular_color[0] + 100));
         lightness += diffuse + specular;
     }
@@ -158,9 +184,10 @@ bool NormalTangentShader::Fragment(const FragmentShaderInput &in, FragmentShader
 }
 
 bool DeferredShader::Fragment(const FragmentShaderInput &in, FragmentShaderOutput &out) const {
+    const Model &model = *in.state.model;
     const Vector3f interpolated_normal = Interpolate(in.triangle[0].normal, in.triangle[1].normal, in.triangle[2].normal, in.bc_clip).Normalize();
     const Vector2f interpolated_uv = Interpolate(in.triangle[0].uv, in.triangle[1].uv, in.triangle[2].uv, in.bc_clip);
-    const Color texture_color = model->diffuse_map() != nullptr ? model->diffuse_map()->GetPixel(interpolated_uv) : Color::White();
+    const Color texture_color = model.diffuse_map() != nullptr ? model.diffuse_map()->GetPixel(interpolated_uv) : Color::White();
     out.color = texture_color;
     out.normal = interpolated_normal;
     return true;
@@ -0,0 +1,159 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+    constexpr std::uint32_t kNoVertex = std::numeric_limits<std::uint32_t>::max();
+
+    struct AttributeTupleHash {
+        size_t operator()(const std::array<int, 3> &tuple) const {
+            std::uint64_t hash = static_cast<std::uint32_t>(tuple[0]);
+            hash = hash * 0x9E3779B97F4A7C15ull ^ static_cast<std::uint32_t>(tuple[1]);
+            hash = hash * 0x9E3779B97F4A7C15ull ^ static_cast<std::uint32_t>(tuple[2]);
+            return static_cast<size_t>(hash ^ hash >> 29);
+        }
+    };
+
+    std::uint16_t QuantizeUnorm16(const float value, const float min, const float scale) {
+        if (scale <= 0) return 0;
+        return static_cast<std::uint16_t>(std::clamp(std::lround((value - min) / scale), 0l, 65535l));
+    }
+
+    std::uint16_t EncodeOctahedral(const Vector3f &normal) {
+        const float sum = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+        if (sum <= 0) return 128 | 128 << 8; // (0, 0, 1)
+        float x = normal[0] / sum, y = normal[1] / sum;
+        if (normal[2] < 0) {
+            const float folded_x = (1 - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+            y = (1 - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+            x = folded_x;
+        }
+        const auto to_byte = [](const float v) { return static_cast<std::uint16_t>(std::clamp(std::lround((v + 1) * 127.5f), 0l, 255l)); };
+        return static_cast<std::uint16_t>(to_byte(x) | to_byte(y) << 8);
+    }
+}
+
+void MeshOptimizer::Weld(const MeshArrays &mesh, std::vector<MeshVertex> &vertices, std::vector<std::uint32_t> &indices) {
+    const size_t corners = mesh.vertex_indices.size();
+    std::unordered_map<std::array<int, 3>, std::uint32_t, AttributeTupleHash> welded;
+    welded.reserve(mesh.vertices.size() * 2);
+    vertices.clear();
+    indices.resize(corners);
+    for (size_t corner = 0; corner < corners; ++corner) {
+        const std::array<int, 3> tuple = {mesh.vertex_indices[corner], mesh.tex_coord_indices[corner], mesh.normal_indices[corner]};
+        const auto [it, inserted] = welded.try_emplace(tuple, static_cast<std::uint32_t>(vertices.size()));
+        if (inserted) vertices.push_back({mesh.vertices[tuple[0]], mesh.normals[tuple[2]], mesh.tex_coords[tuple[1]]});
+        indices[corner] = it->second;
+    }
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<std::uint32_t> &indices, const size_t vertex_count, const size_t cache_size) {
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) return;
+
+    // triangles around every vertex, and how many of them are not emitted yet
+    std::vector<std::uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for (const std::uint32_t index : indices) adjacency_offsets[index + 1]++;
+    for (size_t v = 0; v < vertex_count; ++v) adjacency_offsets[v + 1] += adjacency_offsets[v];
+    std::vector<std::uint32_t> adjacency(indices.size());
+    std::vector<std::uint32_t> live(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v) live[v] = adjacency_offsets[v + 1] - adjacency_offsets[v];
+    {
+        std::vector<std::uint32_t> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (size_t corner = 0; corner < indices.size(); ++corner) adjacency[cursor[indices[corner]]++] = static_cast<std::uint32_t>(corner / 3);
+    }
+
+    // a vertex is in the simulated fifo cache while time - time_stamps[v] <= cache_size
+    std::vector<size_t> time_stamps(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<std::uint32_t> dead_ends, candidates, output;
+    output.reserve(indices.size());
+    size_t time = cache_size + 1;
+    size_t input_cursor = 0;
+    std::uint32_t fanning = 0;
+    while (fanning != kNoVertex) {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (std::uint32_t i = adjacency_offsets[fanning]; i < adjacency_offsets[fanning + 1]; ++i) {
+            const std::uint32_t triangle = adjacency[i];
+            if (emitted[triangle]) continue;
+            for (size_t corner = triangle * 3; corner < triangle * 3 + 3; ++corner) {
+                const std::uint32_t v = indices[corner];
+                output.push_back(v);
+                dead_ends.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - time_stamps[v] > cache_size) time_stamps[v] = time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        // next fanning vertex: the oldest candidate that stays in the cache while its triangles are emitted
+        fanning = kNoVertex;
+        std::int64_t best_priority = -1;
+        for (const std::uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+            std::int64_t priority = 0;
+            if (time - time_stamps[v] + 2 * live[v] <= cache_size) priority = static_cast<std::int64_t>(time - time_stamps[v]);
+            if (priority > best_priority) {
+                best_priority = priority;
+                fanning = v;
+            }
+        }
+        if (fanning != kNoVertex) continue;
+
+        // dead end: the most recently used vertex with triangles left, else the next one in input order
+        while (!dead_ends.empty() && fanning == kNoVertex) {
+            const std::uint32_t v = dead_ends.back();
+            dead_ends.pop_back();
+            if (live[v] > 0) fanning = v;
+        }
+        while (fanning == kNoVertex && input_cursor < vertex_count) {
+            if (live[input_cursor] > 0) fanning = static_cast<std::uint32_t>(input_cursor);
+            else input_cursor++;
+        }
+    }
+    indices = std::move(output);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<MeshVertex> &vertices, std::vector<std::uint32_t> &indices) {
+    std::vector<std::uint32_t> remap(vertices.size(), kNoVertex);
+    std::vector<MeshVertex> reordered;
+    reordered.reserve(vertices.size());
+    for (std::uint32_t &index : indices) {
+        if (remap[index] == kNoVertex) {
+            remap[index] = static_cast<std::uint32_t>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(reordered); // unreferenced vertices are dropped
+}
+
+float MeshOptimizer::GetACMR(const std::vector<std::uint32_t> &indices, const size_t vertex_count, const size_t cache_size) {
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) return 0;
+    std::vector<size_t> time_stamps(vertex_count, 0);
+    size_t time = cache_size + 1;
+    size_t misses = 0;
+    for (const std::uint32_t index : indices) {
+        if (time - time_stamps[index] > cache_size) {
+            time_stamps[index] = time++;
+            misses++;
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(triangle_count);
+}
+
+void MeshOptimizer::Quantize(const std::span<const MeshVertex> vertices, const Vector3f &position_min, const Vector3f &position_scale,
+                             const Vector2f &uv_min, const Vector2f &uv_scale, std::vector<QuantizedVertex> &quantized) {
+    quantized.resize(vertices.size());
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        for (size_t i = 0; i < 3; ++i) quantized[v].position[i] = QuantizeUnorm16(vertices[v].position[i], position_min[i], position_scale[i]);
+        for (size_t i = 0; i < 2; ++i) quantized[v].uv[i] = QuantizeUnorm16(vertices[v].uv[i], uv_min[i], uv_scale[i]);
+        quantized[v].normal = EncodeOctahedral(vertices[v].normal);
+    }
+}
@@ -1,80 +1,457 @@
 #include "model.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
-#include <iostream>
-#include <sstream>
+#include <thread>
+#include "asset_manager.h"
+#include "mesh_optimizer.h"
 #include "utility/log.h"
-#include "tga_handler.h"
-
-Model::Model(const std::string &filename) {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
-    if (in.fail()) return;
-
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line);
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            Vector3f vert;
-            for (int i = 0; i < 3; i++) iss >> vert[i];
-            vertices_.push_back(vert);
-        } else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
-            Vector2f uv;
-            for (int i = 0; i < 2; i++) iss >> uv[i];
-            tex_coords_.push_back({uv[0], 1 - uv[1]});
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
-            Vector3f norm;
-            for (int i = 0; i < 3; i++) iss >> norm[i];
-            normals_.push_back(norm.Normalize());
-        }  else if (!line.compare(0, 2, "f ")) {
-            int f, t, n;
-            iss >> trash;
-            int counter = 0;
-            while (iss >> f >> trash >> t >> trash >> n) {
-                vertex_indices_.push_back(--f);
-                tex_coord_indices_.push_back(--t);
-                normal_indices_.push_back(--n);
-                counter++;
+#include "utility/mapped_file.h"
+#include "utility/thread_pool.h"
+
+namespace {
+    constexpr size_t kObjChunkSize = 1 << 18; // bytes of text per parse task
+
+    /**
+     * @brief attributes and triangulated faces of one line-aligned chunk of an obj file.
+     * absolute indices are stored 0-based. relative (negative) indices may point into previous chunks, they are
+     * stored as their position in this chunk minus kRelative and rebased once the sizes of previous chunks are known.
+     * a missing texture coordinate or normal index is kNoIndex.
+     */
+    struct ObjChunk {
+        static constexpr std::int64_t kNoIndex = std::numeric_limits<std::int64_t>::min();
+        static constexpr std::int64_t kRelative = std::int64_t{1} << 40;
+
+        std::vector<Vector3f> vertices;
+        std::vector<Vector2f> tex_coords;
+        std::vector<Vector3f> normals;
+        std::vector<std::int64_t> vertex_indices;
+        std::vector<std::int64_t> tex_coord_indices;
+        std::vector<std::int64_t> normal_indices;
+        size_t skipped_faces = 0;
+    };
+
+    const char* SkipSpaces(const char *p, const char *end) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        return p;
+    }
+
+    template<size_t N>
+    bool ParseFloats(const char *p, const char *end, Vector<float, N> &out) {
+        for (size_t i = 0; i < N; ++i) {
+            p = SkipSpaces(p, end);
+            if (p < end && *p == '+') ++p; // from_chars does not take a leading plus
+            const auto [next, error] = std::from_chars(p, end, out[i]);
+            if (error != std::errc()) return false;
+            p = next;
+        }
+        return true;
+    }
+
+    // obj indices are 1-based, negative ones count back from the last element defined so far
+    bool ParseIndex(const char *&p, const char *end, const size_t defined, std::int64_t &out) {
+        std::int64_t value = 0;
+        const auto [next, error] = std::from_chars(p, end, value);
+        if (error != std::errc() || value == 0) return false;
+        p = next;
+        out = value > 0 ? value - 1 : static_cast<std::int64_t>(defined) + value - ObjChunk::kRelative;
+        return true;
+    }
+
+    // parses "v", "v/t", "v//n" and "v/t/n" corners and fan-triangulates polygons
+    bool ParseFace(const char *p, const char *end, ObjChunk &chunk) {
+        std::int64_t corners[3][64];
+        size_t count = 0;
+        while (true) {
+            p = SkipSpaces(p, end);
+            if (p >= end) break;
+            if (count == 64) return false;
+            std::int64_t v, t = ObjChunk::kNoIndex, n = ObjChunk::kNoIndex;
+            if (!ParseIndex(p, end, chunk.vertices.size(), v)) return false;
+            if (p < end && *p == '/') {
+                ++p;
+                if (p < end && *p != '/' && !ParseIndex(p, end, chunk.tex_coords.size(), t)) return false;
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (!ParseIndex(p, end, chunk.normals.size(), n)) return false;
+                }
+            }
+            if (p < end && *p != ' ' && *p != '\t') return false;
+            corners[0][count] = v;
+            corners[1][count] = t;
+            corners[2][count] = n;
+            count++;
+        }
+        if (count < 3) return false;
+        for (size_t i = 1; i + 1 < count; ++i) {
+            for (const size_t corner : {size_t{0}, i, i + 1}) {
+                chunk.vertex_indices.push_back(corners[0][corner]);
+                chunk.tex_coord_indices.push_back(corners[1][corner]);
+                chunk.normal_indices.push_back(corners[2][corner]);
+            }
+        }
+        return true;
+    }
+
+    void ParseObjChunk(const char *begin, const char *end, ObjChunk &chunk) {
+        for (const char *line = begin; line < end;) {
+            const char *line_end = static_cast<const char*>(std::memchr(line, '\n', end - line));
+            if (line_end == nullptr) line_end = end;
+            const char *next_line = line_end + (line_end < end ? 1 : 0);
+            if (line_end > line && line_end[-1] == '\r') --line_end;
+            const char *p = SkipSpaces(line, line_end);
+            const size_t length = line_end - p;
+
+            if (length > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+                Vector3f vertex;
+                if (ParseFloats(p + 2, line_end, vertex)) chunk.vertices.push_back(vertex);
+            } else if (length > 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+                Vector2f uv;
+                if (ParseFloats(p + 3, line_end, uv)) chunk.tex_coords.push_back({uv[0], 1 - uv[1]});
+            } else if (length > 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+                Vector3f normal;
+                if (ParseFloats(p + 3, line_end, normal)) chunk.normals.push_back(normal.Normalize());
+            } else if (length > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+                const size_t indices = chunk.vertex_indices.size();
+                if (!ParseFace(p + 2, line_end, chunk)) {
+                    chunk.vertex_indices.resize(indices);
+                    chunk.tex_coord_indices.resize(indices);
+                    chunk.normal_indices.resize(indices);
+                    chunk.skipped_faces++;
+                }
+            }
+            line = next_line;
+        }
+    }
+
+    // rebases relative indices and appends the chunk indices, missing ones become -1 and invalid ones kInvalidIndex
+    constexpr int kInvalidIndex = std::numeric_limits<int>::max();
+
+    void AppendIndices(const std::vector<std::int64_t> &chunk_indices, const size_t offset, const size_t size, std::vector<int> &indices) {
+        for (const std::int64_t index : chunk_indices) {
+            if (index == ObjChunk::kNoIndex) {
+                indices.push_back(-1);
+                continue;
+            }
+            const std::int64_t resolved = index < 0 ? static_cast<std::int64_t>(offset) + index + ObjChunk::kRelative : index;
+            indices.push_back(resolved >= 0 && resolved < static_cast<std::int64_t>(size) ? static_cast<int>(resolved) : kInvalidIndex);
+        }
+    }
+
+    bool ParseObj(const std::string &filename, MeshArrays &mesh) {
+        const MappedFile file(filename);
+        if (!file.is_open()) {
+            LOG_ERROR("Model - cannot open model file: " + filename);
+            return false;
+        }
+
+        // split into line-aligned chunks, parse them in parallel and merge them in file order
+        const char *data = file.data();
+        const size_t size = file.size();
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (size_t begin = 0; begin < size;) {
+            size_t end = std::min(size, begin + kObjChunkSize);
+            const void *newline = end < size ? std::memchr(data + end, '\n', size - end) : nullptr;
+            end = newline != nullptr ? static_cast<const char*>(newline) - data + 1 : size;
+            ranges.emplace_back(begin, end);
+            begin = end;
+        }
+        std::vector<ObjChunk> chunks(ranges.size());
+        ThreadPool::Instance().ParallelFor(0, chunks.size(), [&](const size_t i) {
+            ParseObjChunk(data + ranges[i].first, data + ranges[i].second, chunks[i]);
+        });
+
+        size_t vertices = 0, tex_coords = 0, normals = 0, indices = 0, skipped_faces = 0;
+        for (const auto &chunk : chunks) {
+            vertices += chunk.vertices.size();
+            tex_coords += chunk.tex_coords.size();
+            normals += chunk.normals.size();
+            indices += chunk.vertex_indices.size();
+            skipped_faces += chunk.skipped_faces;
+        }
+        mesh.vertices.reserve(vertices);
+        mesh.tex_coords.reserve(tex_coords + 1);
+        mesh.normals.reserve(normals);
+        mesh.vertex_indices.reserve(indices);
+        mesh.tex_coord_indices.reserve(indices);
+        mesh.normal_indices.reserve(indices);
+        for (const auto &chunk : chunks) {
+            AppendIndices(chunk.vertex_indices, mesh.vertices.size(), vertices, mesh.vertex_indices);
+            AppendIndices(chunk.tex_coord_indices, mesh.tex_coords.size(), tex_coords, mesh.tex_coord_indices);
+            AppendIndices(chunk.normal_indices, mesh.normals.size(), normals, mesh.normal_indices);
+            mesh.vertices.insert(mesh.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+            mesh.tex_coords.insert(mesh.tex_coords.end(), chunk.tex_coords.begin(), chunk.tex_coords.end());
+            mesh.normals.insert(mesh.normals.end(), chunk.normals.begin(), chunk.normals.end());
+        }
+
+        // drop the triangles that reference elements which do not exist
+        size_t kept = 0;
+        for (size_t corner = 0; corner < mesh.vertex_indices.size(); corner += 3) {
+            bool valid = true;
+            for (size_t i = corner; i < corner + 3; ++i)
+                valid &= mesh.vertex_indices[i] != kInvalidIndex && mesh.tex_coord_indices[i] != kInvalidIndex && mesh.normal_indices[i] != kInvalidIndex;
+            if (!valid) {
+                skipped_faces++;
+                continue;
+            }
+            for (size_t i = corner; i < corner + 3; ++i, ++kept) {
+                mesh.vertex_indices[kept] = mesh.vertex_indices[i];
+                mesh.tex_coord_indices[kept] = mesh.tex_coord_indices[i];
+                mesh.normal_indices[kept] = mesh.normal_indices[i];
             }
-            if (counter != 3) {
-                LOG_ERROR("Model - the model file is supposed to be triangulated");
-                return;
+        }
+        mesh.vertex_indices.resize(kept);
+        mesh.tex_coord_indices.resize(kept);
+        mesh.normal_indices.resize(kept);
+        if (skipped_faces > 0) LOG_WARNING("Model - " + filename + ": skipped " + std::to_string(skipped_faces) + " malformed face(s)");
+
+        // corners without a texture coordinate share a default one, corners without a normal use the face normal
+        const size_t default_tex_coord = mesh.tex_coords.size();
+        bool uses_default_tex_coord = false;
+        for (size_t face = 0; face < mesh.vertex_indices.size() / 3; ++face) {
+            for (size_t corner = face * 3; corner < face * 3 + 3; ++corner) {
+                if (mesh.tex_coord_indices[corner] < 0) {
+                    mesh.tex_coord_indices[corner] = static_cast<int>(default_tex_coord);
+                    uses_default_tex_coord = true;
+                }
+            }
+            if (mesh.normal_indices[face * 3] >= 0 && mesh.normal_indices[face * 3 + 1] >= 0 && mesh.normal_indices[face * 3 + 2] >= 0) continue;
+            const auto corner = [&](const size_t i) { return mesh.vertices[mesh.vertex_indices[face * 3 + i]]; };
+            const Vector3f face_normal = Vector3f::Cross(corner(1) - corner(0), corner(2) - corner(0));
+            const float magnitude = face_normal.Magnitude();
+            mesh.normals.push_back(magnitude > 0 ? face_normal / magnitude : Vector3f{0, 0, 1});
+            for (size_t corner = face * 3; corner < face * 3 + 3; ++corner)
+                if (mesh.normal_indices[corner] < 0) mesh.normal_indices[corner] = static_cast<int>(mesh.normals.size() - 1);
+        }
+        if (uses_default_tex_coord) mesh.tex_coords.push_back({0, 0});
+        return true;
+    }
+
+    /**
+     * @brief layout of a mesh cache file: this header, then the arrays at 16 byte aligned offsets in native byte order.
+     */
+    struct MeshCacheHeader {
+        static constexpr char kMagic[8] = {'H', 'M', 'X', 'S', 'M', 'E', 'S', 'H'};
+        static constexpr std::uint32_t kVersion = 3; // 3 parses "v\t", older caches of such files lack their vertices
+        static constexpr size_t kArrays = 2; // interleaved vertices, indices
+
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t header_size;
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+        float bounds[6];
+        std::uint64_t counts[kArrays];
+        std::uint64_t offsets[kArrays];
+    };
+
+    constexpr size_t kElementSizes[MeshCacheHeader::kArrays] = {
+        sizeof(MeshVertex), sizeof(std::uint32_t)
+    };
+
+    constexpr const char* kTextureSuffixes[] = {"_diffuse.tga", "_spec.tga", "_nm.tga", "_nm_tangent.tga"};
+    constexpr const char* kTextureNames[] = {"diffuse_map:        ", "specular_map:       ", "normal_map:         ", "normal_map_tangent: "};
+
+    std::string GetMeshCachePath(const std::string &filename) { return filename + ".meshcache"; }
+
+    bool GetSourceStamp(const std::string &filename, std::uint64_t &size, std::int64_t &mtime) {
+        std::error_code error;
+        size = std::filesystem::file_size(filename, error);
+        if (error) return false;
+        mtime = std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+        return !error;
+    }
+}
+
+Model::Model(const std::string &filename, const MeshFormat format) : filename_(filename) {
+    if (!LoadMeshCache(filename)) {
+        MeshArrays mesh;
+        if (!ParseObj(filename, mesh)) return;
+        MeshOptimizer::Weld(mesh, vertex_storage_, index_storage_);
+        const float acmr_before = MeshOptimizer::GetACMR(index_storage_, vertex_storage_.size());
+        MeshOptimizer::OptimizeVertexCache(index_storage_, vertex_storage_.size());
+        MeshOptimizer::OptimizeVertexFetch(vertex_storage_, index_storage_);
+        const float acmr_after = MeshOptimizer::GetACMR(index_storage_, vertex_storage_.size());
+        LOG_INFO("Model - " + filename + ": welded " + std::to_string(mesh.vertex_indices.size()) + " corners into " + std::to_string(vertex_storage_.size()) +
+                 " vertices, ACMR " + std::to_string(acmr_before) + " -> " + std::to_string(acmr_after));
+        vertices_ = vertex_storage_;
+        indices_ = index_storage_;
+        if (!vertices_.empty()) bounds_min_ = bounds_max_ = vertices_[0].position;
+        for (const auto &vertex : vertices_) {
+            for (size_t i = 0; i < 3; ++i) {
+                bounds_min_[i] = std::min(bounds_min_[i], vertex.position[i]);
+                bounds_max_[i] = std::max(bounds_max_[i], vertex.position[i]);
             }
         }
+        WriteMeshCache(filename);
     }
-    diffuse_map_ = LoadTGAImage(filename, "_diffuse.tga");
-    specular_map_ = LoadTGAImage(filename, "_spec.tga");
-    normal_map_ = LoadTGAImage(filename, "_nm.tga");
-    normal_map_tangent_ = LoadTGAImage(filename, "_nm_tangent.tga");
+    if (format == QUANTIZED) Quantize();
+
     LOG_INFO("model:" + filename + " load success");
-    LOG_INFO("v-" + std::to_string(vertices_size()) + " f-" + std::to_string(faces_size()) + " vt-" + std::to_string(tex_coords_.size()) + " vn-" + std::to_string(normals_.size()));
-    LOG_INFO("diffuse_map:        " + std::to_string(diffuse_map_->width()) + " x " + std::to_string(diffuse_map_->height()) + " / " + std::to_string(diffuse_map_->bpp() * 8));
-    LOG_INFO("specular_map:       " + std::to_string(specular_map_->width()) + " x " + std::to_string(specular_map_->height()) + " / " + std::to_string(specular_map_->bpp() * 8));
-    LOG_INFO("normal_map:         " + std::to_string(normal_map_->width()) + " x " + std::to_string(normal_map_->height()) + " / " + std::to_string(normal_map_->bpp() * 8));
-    LOG_INFO("normal_map_tangent: " + std::to_string(normal_map_tangent_->width()) + " x " + std::to_string(normal_map_tangent_->height()) + " / " + std::to_string(normal_map_tangent_->bpp() * 8));
+    LOG_INFO("v-" + std::to_string(vertices_size()) + " f-" + std::to_string(faces_size()));
+}
+
+void Model::RequireTextures(const std::uint32_t slots) const {
+    PublishTextures(slots, false);
+}
+
+void Model::WaitForTextures(const std::uint32_t slots) const {
+    PublishTextures(slots, true);
+}
+
+void Model::PublishTextures(const std::uint32_t slots, const bool wait) const {
+    const std::uint32_t required = slots & ALL_TEXTURE_MAPS;
+    if ((published_textures_.load(std::memory_order_acquire) & required) == required) return;
+    std::lock_guard lock(texture_mutex_);
+    std::uint32_t published = published_textures_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < kTextureSlots; ++i) {
+        if ((required & 1u << i) == 0 || (published & 1u << i) != 0) continue;
+        if ((requested_textures_ & 1u << i) == 0) {
+            texture_loads_[i] = LoadTGAImage(filename_, kTextureSuffixes[i]);
+            requested_textures_ |= 1u << i;
+        }
+        // a missing file has no load to wait for and is published as nullptr right away
+        if (texture_loads_[i].valid() && !wait && !texture_loads_[i].is_ready()) continue;
+        texture_storage_[i] = texture_loads_[i].wait();
+        texture_loads_[i] = {};
+        const ColorBuffer *map = texture_storage_[i].get();
+        texture_maps_[i].store(map, std::memory_order_release);
+        published |= 1u << i;
+        LOG_INFO("model:" + filename_ + " " + kTextureNames[i] + (map == nullptr ? std::string("none") :
+                 std::to_string(map->width()) + " x " + std::to_string(map->height()) + " / " + std::to_string(map->bpp() * 8)));
+    }
+    published_textures_.store(published, std::memory_order_release);
+}
+
+bool Model::LoadMeshCache(const std::string &filename) {
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+    if (!GetSourceStamp(filename, source_size, source_mtime)) return false;
+    MappedFile file(GetMeshCachePath(filename));
+    if (!file.is_open() || file.size() < sizeof(MeshCacheHeader)) return false;
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, MeshCacheHeader::kMagic, sizeof(header.magic)) != 0 || header.version != MeshCacheHeader::kVersion ||
+        header.header_size != sizeof(MeshCacheHeader) || header.source_size != source_size || header.source_mtime != source_mtime) {
+        LOG_INFO("Model - mesh cache of " + filename + " is out of date");
+        return false;
+    }
+    for (size_t i = 0; i < MeshCacheHeader::kArrays; ++i) {
+        if (header.offsets[i] % 16 != 0 || header.offsets[i] > file.size() ||
+            header.counts[i] > (file.size() - header.offsets[i]) / kElementSizes[i]) {
+            LOG_WARNING("Model - mesh cache of " + filename + " is corrupt");
+            return false;
+        }
+    }
+    const char *data = file.data();
+    const std::span<const std::uint32_t> indices = {reinterpret_cast<const std::uint32_t*>(data + header.offsets[1]), header.counts[1]};
+    if (indices.size() % 3 != 0 || std::any_of(indices.begin(), indices.end(), [&](const std::uint32_t i) { return i >= header.counts[0]; })) {
+        LOG_WARNING("Model - mesh cache of " + filename + " is corrupt");
+        return false;
+    }
+
+    vertices_ = {reinterpret_cast<const MeshVertex*>(data + header.offsets[0]), header.counts[0]};
+    indices_ = indices;
+    bounds_min_ = {header.bounds[0], header.bounds[1], header.bounds[2]};
+    bounds_max_ = {header.bounds[3], header.bounds[4], header.bounds[5]};
+    cache_file_ = std::move(file);
+    return true;
+}
+
+void Model::WriteMeshCache(const std::string &filename) const {
+    MeshCacheHeader header {};
+    std::memcpy(header.magic, MeshCacheHeader::kMagic, sizeof(header.magic));
+    header.version = MeshCacheHeader::kVersion;
+    header.header_size = sizeof(MeshCacheHeader);
+    if (!GetSourceStamp(filename, header.source_size, header.source_mtime)) return;
+    for (size_t i = 0; i < 3; ++i) {
+        header.bounds[i] = bounds_min_[i];
+        header.bounds[i + 3] = bounds_max_[i];
+    }
+    const void *arrays[MeshCacheHeader::kArrays] = {vertices_.data(), indices_.data()};
+    const size_t counts[MeshCacheHeader::kArrays] = {vertices_.size(), indices_.size()};
+    size_t offset = (sizeof(MeshCacheHeader) + 15) / 16 * 16;
+    for (size_t i = 0; i < MeshCacheHeader::kArrays; ++i) {
+        header.counts[i] = counts[i];
+        header.offsets[i] = offset;
+        offset = (offset + counts[i] * kElementSizes[i] + 15) / 16 * 16;
+    }
+    std::vector<char> buffer(offset, 0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    for (size_t i = 0; i < MeshCacheHeader::kArrays; ++i)
+        if (counts[i] > 0) std::memcpy(buffer.data() + header.offsets[i], arrays[i], counts[i] * kElementSizes[i]);
+
+    // written under a temporary name and renamed, so concurrent loads never map a partial file
+    const std::string cache_path = GetMeshCachePath(filename);
+    const std::string temp_path = cache_path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+            LOG_WARNING("Model - cannot write mesh cache: " + cache_path);
+            out.close();
+            std::filesystem::remove(temp_path);
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error) {
+        LOG_WARNING("Model - cannot write mesh cache: " + cache_path);
+        std::filesystem::remove(temp_path, error);
+    }
+}
+
+void Model::Quantize() {
+    const size_t full_bytes = vertices_.size_bytes() + indices_.size_bytes();
+    Vector2f uv_max;
+    if (!vertices_.empty()) uv_min_ = uv_max = vertices_[0].uv;
+    for (const auto &vertex : vertices_) {
+        for (size_t i = 0; i < 2; ++i) {
+            uv_min_[i] = std::min(uv_min_[i], vertex.uv[i]);
+            uv_max[i] = std::max(uv_max[i], vertex.uv[i]);
+        }
+    }
+    for (size_t i = 0; i < 3; ++i) position_scale_[i] = (bounds_max_[i] - bounds_min_[i]) / 65535.0f;
+    for (size_t i = 0; i < 2; ++i) uv_scale_[i] = (uv_max[i] - uv_min_[i]) / 65535.0f;
+    MeshOptimizer::Quantize(vertices_, bounds_min_, position_scale_, uv_min_, uv_scale_, quantized_vertices_);
+
+    // the full precision arrays are released, 32 bit indices stay (possibly mapped) when there are too many vertices
+    if (vertices_.size() <= 65536) {
+        short_indices_.assign(indices_.begin(), indices_.end());
+        indices_ = {};
+        index_storage_ = {};
+        cache_file_ = MappedFile();
+    }
+    vertices_ = {};
+    vertex_storage_ = {};
+    format_ = QUANTIZED;
+    const size_t quantized_bytes = quantized_vertices_.size() * sizeof(QuantizedVertex) + short_indices_.size() * sizeof(std::uint16_t) + indices_.size_bytes();
+    LOG_INFO("Model - quantized " + std::to_string(full_bytes) + " bytes of vertices and indices to " + std::to_string(quantized_bytes));
 }
 
 Vector3f Model::normal(const Vector2f &uvf) const {
-    Color color = normal_map_->GetPixel(
-        static_cast<size_t>(uvf[0] * static_cast<float>(normal_map_tangent_->width())),
-        static_cast<size_t>(uvf[1] * static_cast<float>(normal_map_tangent_->height())));
+    const ColorBuffer &map = *normal_map();
+    Color color = map.GetPixel(
+        static_cast<size_t>(uvf[0] * static_cast<float>(map.width())),
+        static_cast<size_t>(uvf[1] * static_cast<float>(map.height())));
     return Vector3f{static_cast<float>(color[2]), static_cast<float>(color[1]), static_cast<float>(color[0])} * 2.0 / 255.0 - Vector3f{1, 1, 1}; // mappped from [0, 255] to [-1, 1]
 }
 
 Vector3f Model::normal_tangent(const Vector2f &uvf) const {
-    Color color = normal_map_tangent_->GetPixel(
-        static_cast<size_t>(uvf[0] * static_cast<float>(normal_map_tangent_->width())),
-        static_cast<size_t>(uvf[1] * static_cast<float>(normal_map_tangent_->height())));
+    const ColorBuffer &map = *normal_map_tangent();
+    Color color = map.GetPixel(
+        static_cast<size_t>(uvf[0] * static_cast<float>(map.width())),
+        static_cast<size_t>(uvf[1] * static_cast<float>(map.height())));
     return Vector3f{static_cast<float>(color[2]), static_cast<float>(color[1]), static_cast<float>(color[0])} * 2.0 / 255.0 - Vector3f{1, 1, 1}; // mappped from [0, 255] to [-1, 1]
 }
 
-std::unique_ptr<ColorBuffer> Model::LoadTGAImage(const std::string &filename, const std::string &suffix) {
+AssetHandle<const ColorBuffer> Model::LoadTGAImage(const std::string &filename, const std::string &suffix) {
     const size_t dot = filename.find_last_of('.');
-    if (dot == std::string::npos) return nullptr;
+    if (dot == std::string::npos) return {};
     const std::string texture_file_name = filename.substr(0, dot) + suffix;
-    return TGAHandler::ReadTGAFile(texture_file_name);
+    if (!std::filesystem::exists(texture_file_name)) return {}; // maps are optional
+    return AssetManager::Instance().LoadTextureAsync(texture_file_name);
 }
@@ -1,8 +1,40 @@
 #include "renderer.h"
+#include <algorithm>
+#include <bit>
 #include <cmath>
+#include "mesh_optimizer.h"
 #include "utility/log.h"
+#include "utility/profiler.h"
+#include "utility/thread_pool.h"
 #include "scene.h"
 
+namespace {
+    /**
+     * @brief the two source pixels of an upscaled column or row and the 8 bit weight of the second.
+     */
+    struct UpscaleTap {
+        std::uint32_t first;
+        std::uint32_t second;
+        std::uint16_t weight;   // 0 to 256
+    };
+
+    // blends two bytes by an 8 bit weight, the sum never leaves 16 bits so loops over it vectorize 8 or 16 wide
+    std::uint8_t Blend(const std::uint8_t a, const std::uint8_t b, const std::uint16_t weight) {
+        return static_cast<std::uint8_t>(static_cast<std::uint16_t>(a * (256 - weight) + b * weight + 128) >> 8);
+    }
+
+    // horizontal pass of the bilinear upscale, kChannels = 0 takes the channel count at run time
+    template<size_t kChannels>
+    void FilterRow(const std::uint8_t *pixels, const std::span<const UpscaleTap> columns, const size_t channels, std::uint8_t *out) {
+        const size_t count = kChannels != 0 ? kChannels : channels;
+        for (const UpscaleTap &column : columns) {
+            const std::uint8_t *left = pixels + column.first * count, *right = pixels + column.second * count;
+            for (size_t c = 0; c < count; ++c) out[c] = Blend(left[c], right[c], column.weight);
+            out += count;
+        }
+    }
+}
+
 void Renderer::DrawLine(Vector2f p0, Vector2f p1, const Color &color, const ColorBuffer &buffer) {
     bool steep = false;
     if (std::abs(p0[0] - p1[0]) < std::abs(p0[1] - p1[1])) {
@@ -31,48 +63,314 @@ void Renderer::DrawLine(Vector2f p0, Vector2f p1, const Color &color, const Colo
     }
 }
 
-void Renderer::DrawModel(const Model &model,
-                         const IShader &shader,
+void Renderer::DrawModel(const DrawState &state,
                          const FrameBuffer &frame_buffer,
                          const GBuffer &g_buffer,
                          const RenderPath &render_path) {
-    for (int face_index = 0; face_index < model.faces_size(); face_index++) {
-        std::array<Vertex, 3> vertex_shader_output{};
-        for (const int vertex_index : {0, 1, 2}) {
-            VertexShaderInput vertex_shader_input {
-                .vertex_model_space = model.vertex(face_index, vertex_index),
-                .normal = model.normal(face_index, vertex_index),
-                .uv = model.uv(face_index, vertex_index)
-            };
-            shader.VertexShader(vertex_shader_input, vertex_shader_output[vertex_index]);
+    Submit({&state, 1}, frame_buffer, g_buffer, render_path);
+}
+
+void Renderer::Submit(const std::span<const DrawState> draws,
+                      const FrameBuffer &frame_buffer,
+                      const GBuffer &g_buffer,
+                      const RenderPath &render_path,
+                      FrameArena *arena) {
+    constexpr size_t kTrianglesPerBatch = 4096;
+    const auto is_drawable = [](const DrawState &state) {
+        return state.model != nullptr && state.shader != nullptr && state.frame != nullptr && !state.instances.empty();
+    };
+    // a batch holds whole instances of a small model, or a range of faces of one instance of a large one
+    const auto get_instances_per_batch = [](const DrawState &state) { return std::max<size_t>(1, kTrianglesPerBatch / state.model->faces_size()); };
+    const auto get_batch_count = [&](const DrawState &state) {
+        const size_t faces = state.model->faces_size();
+        if (faces >= kTrianglesPerBatch) return state.instances.size() * ((faces + kTrianglesPerBatch - 1) / kTrianglesPerBatch);
+        return (state.instances.size() + get_instances_per_batch(state) - 1) / get_instances_per_batch(state);
+    };
+
+    // instances of every draw sorted front to back, like the draws themselves, so early-z also works inside a draw
+    size_t batch_count = 0, instance_count = 0;
+    for (const auto &state : draws) {
+        if (!is_drawable(state) || state.model->faces_size() == 0) continue;
+        batch_count += get_batch_count(state);
+        instance_count += state.instances.size();
+    }
+    ArenaVector<std::uint32_t> instance_order{ArenaAllocator<std::uint32_t>(arena)};
+    instance_order.reserve(instance_count);
+    ArenaVector<TriangleBatch> batches{ArenaAllocator<TriangleBatch>(arena)};
+    batches.reserve(batch_count);
+    for (const auto &state : draws) {
+        if (!is_drawable(state) || state.model->faces_size() == 0) continue;
+        state.model->RequireTextures(state.shader->texture_slots);
+        const auto order = instance_order.end();
+        for (std::uint32_t i = 0; i < state.instances.size(); ++i) instance_order.push_back(i);
+        const auto get_depth = [&state](const std::uint32_t i) { return std::max(0.0f, -state.instances[i].model_view_matrix[2][3]); };
+        std::sort(order, instance_order.end(), [&](const std::uint32_t a, const std::uint32_t b) {
+            return get_depth(a) != get_depth(b) ? get_depth(a) < get_depth(b) : a < b;
+        });
+        const std::span<const std::uint32_t> instances(order, instance_order.end());
+
+        const size_t faces = state.model->faces_size();
+        const size_t instances_per_batch = faces >= kTrianglesPerBatch ? 1 : get_instances_per_batch(state);
+        const size_t faces_per_batch = std::min(faces, kTrianglesPerBatch);
+        for (size_t instance = 0; instance < instances.size(); instance += instances_per_batch) {
+            for (size_t face_begin = 0; face_begin < faces; face_begin += faces_per_batch) {
+                TriangleBatch batch(arena);
+                batch.state = &state;
+                batch.instances = instances.subspan(instance, std::min(instances_per_batch, instances.size() - instance));
+                batch.face_begin = face_begin;
+                batch.face_end = std::min(faces, face_begin + faces_per_batch);
+                batches.push_back(std::move(batch));
+            }
+        }
+    }
+    if (batches.empty()) return;
+
+    const size_t width = frame_buffer.render_width(), height = frame_buffer.render_height();
+    const float padding = frame_buffer.samples() > 1 ? kSamplePadding : 0.0f;
+    ThreadPool::Instance().ParallelFor(0, batches.size(), [&](const size_t i) {
+        ProcessVertices(batches[i], width, height, padding);
+    });
+
+    // each tile is owned by a single thread, no two threads ever touch the same pixel
+    const size_t tiles_x = (width + kTileSize - 1) / kTileSize;
+    const size_t tiles_y = (height + kTileSize - 1) / kTileSize;
+    ThreadPool::Instance().ParallelFor(0, tiles_x * tiles_y, [&](const size_t tile) {
+        const Vector2s tile_min = {tile % tiles_x * kTileSize, tile / tiles_x * kTileSize};
+        const Vector2s tile_max = {std::min(tile_min[0] + kTileSize, width) - 1, std::min(tile_min[1] + kTileSize, height) - 1};
+        PROFILE_SCOPE(Rasterization);
+        for (const auto &batch : batches) {
+            for (std::uint32_t i = batch.bin_offsets[tile]; i < batch.bin_offsets[tile + 1]; ++i) {
+                RasterizeTriangle(batch.triangles[batch.bin_triangles[i]], *batch.state, frame_buffer, g_buffer, render_path, tile_min, tile_max);
+            }
+        }
+    });
+}
+
+OverdrawStats Renderer::DrawOverdrawHeatmap(const GBuffer &g_buffer, const FrameBuffer &frame_buffer, FrameArena *arena) {
+    if (g_buffer.overdraw == nullptr) return {};
+    const VectorBuffer<2> &overdraw = *g_buffer.overdraw;
+    static const std::array<Color, 5> kRamp = {
+        Color{255, 0, 0, 255}, Color{255, 255, 0, 255}, Color{0, 255, 0, 255}, Color{0, 255, 255, 255}, Color{0, 0, 255, 255}
+    };
+
+    // bands of tile rows, so lazily cleared tiles are never filled by two threads
+    const size_t bands = (frame_buffer.render_height() + kTileSize - 1) / kTileSize;
+    ArenaVector<OverdrawStats> band_stats(bands, ArenaAllocator<OverdrawStats>(arena));
+    ThreadPool::Instance().ParallelFor(0, bands, [&](const size_t band) {
+        OverdrawStats &stats = band_stats[band];
+        for (size_t y = band * kTileSize; y < std::min((band + 1) * kTileSize, frame_buffer.render_height()); ++y) {
+            for (size_t x = 0; x < frame_buffer.render_width(); ++x) {
+                const Vector2f counts = overdraw.Get(x, y);
+                if (counts[0] == 0) {
+                    frame_buffer.color_buffer.SetPixel(x, y, Color{0, 0, 0, 255});
+                    continue;
+                }
+                stats.covered_pixels++;
+                stats.depth_tests += static_cast<size_t>(counts[0]);
+                stats.fragments += static_cast<size_t>(counts[1]);
+                stats.max_overdraw = std::max(stats.max_overdraw, counts[1]);
+                if (counts[1] == 0) {
+                    frame_buffer.color_buffer.SetPixel(x, y, Color{0, 0, 0, 255});
+                    continue;
+                }
+                const float heat = std::clamp((counts[1] - 1) / (kMaxHeat - 1), 0.0f, 1.0f) * static_cast<float>(kRamp.size() - 1);
+                const size_t i = std::min(static_cast<size_t>(heat), kRamp.size() - 2);
+                const float t = heat - static_cast<float>(i);
+                frame_buffer.color_buffer.SetPixel(x, y, kRamp[i] * (1 - t) + kRamp[i + 1] * t);
+            }
+        }
+    });
+
+    OverdrawStats stats;
+    for (const auto &band : band_stats) {
+        stats.covered_pixels += band.covered_pixels;
+        stats.depth_tests += band.depth_tests;
+        stats.fragments += band.fragments;
+        stats.max_overdraw = std::max(stats.max_overdraw, band.max_overdraw);
+    }
+    return stats;
+}
+
+void Renderer::ResolveMultisample(const FrameBuffer &frame_buffer) {
+    if (frame_buffer.multisample == nullptr) return;
+    const MultisampleBuffer &multisample = *frame_buffer.multisample;
+    const size_t samples = multisample.samples();
+
+    // bands of tile rows, so lazily cleared tiles are never filled by two threads
+    const size_t bands = (frame_buffer.render_height() + kTileSize - 1) / kTileSize;
+    ThreadPool::Instance().ParallelFor(0, bands, [&](const size_t band) {
+        PROFILE_SCOPE(MultisampleResolve);
+        for (size_t y = band * kTileSize; y < std::min((band + 1) * kTileSize, frame_buffer.render_height()); ++y) {
+            for (size_t x = 0; x < frame_buffer.render_width(); ++x) {
+                // nothing was drawn there, the color and depth buffers were cleared to the same values
+                if (multisample.IsCleared(x, y)) continue;
+                const float *depths = multisample.depths(x, y);
+                frame_buffer.depth_buffer.Set(x, y, *std::min_element(depths, depths + samples));
+                frame_buffer.color_buffer.SetPixel(x, y, multisample.pixel(x, y)->Resolve(samples));
+            }
+        }
+    });
+}
+
+void Renderer::Upscale(const FrameBuffer &frame_buffer, FrameArena *arena) {
+    if (!frame_buffer.is_scaled()) return;
+    const ColorBuffer &color_buffer = frame_buffer.color_buffer;
+    const size_t source_width = frame_buffer.render_width(), source_height = frame_buffer.render_height();
+    const size_t bpp = color_buffer.bpp();
+    // the region is overwritten while it is read, it is copied out first
+    ArenaVector<std::uint8_t> source(source_width * source_height * bpp, ArenaAllocator<std::uint8_t>(arena));
+    for (size_t y = 0; y < source_height; ++y) color_buffer.GetRow(y, source.data() + y * source_width * bpp, source_width);
+
+    // pixel centers of the source and the output line up
+    const auto get_taps = [arena](const size_t source_size, const size_t size) {
+        ArenaVector<UpscaleTap> taps(size, ArenaAllocator<UpscaleTap>(arena));
+        const float ratio = static_cast<float>(source_size) / static_cast<float>(size);
+        for (size_t i = 0; i < size; ++i) {
+            const float position = std::clamp((static_cast<float>(i) + 0.5f) * ratio - 0.5f, 0.0f, static_cast<float>(source_size - 1));
+            const auto first = static_cast<std::uint32_t>(position);
+            taps[i] = {first, std::min(first + 1, static_cast<std::uint32_t>(source_size - 1)),
+                       static_cast<std::uint16_t>((position - static_cast<float>(first)) * 256.0f + 0.5f)};
+        }
+        return taps;
+    };
+    const ArenaVector<UpscaleTap> columns = get_taps(source_width, frame_buffer.width());
+    const ArenaVector<UpscaleTap> rows = get_taps(source_height, frame_buffer.height());
+
+    // separable: source rows are filtered horizontally once, output rows blend two of them.
+    // bands of tile rows, so lazily cleared tiles are never filled by two threads
+    const size_t bands = (frame_buffer.height() + kTileSize - 1) / kTileSize;
+    ThreadPool::Instance().ParallelFor(0, bands, [&](const size_t band) {
+        PROFILE_SCOPE(Upscale);
+        const size_t row_size = frame_buffer.width() * bpp;
+        ArenaVector<std::uint8_t> upper(row_size, ArenaAllocator<std::uint8_t>(arena));
+        ArenaVector<std::uint8_t> lower(row_size, ArenaAllocator<std::uint8_t>(arena));
+        ArenaVector<std::uint8_t> output(row_size, ArenaAllocator<std::uint8_t>(arena));
+        std::uint32_t upper_row = std::numeric_limits<std::uint32_t>::max(), lower_row = upper_row;
+        const auto filter_row = [&](const std::uint32_t source_row, ArenaVector<std::uint8_t> &filtered) {
+            const std::uint8_t *pixels = source.data() + source_row * source_width * bpp;
+            if (bpp == RGBA) FilterRow<RGBA>(pixels, columns, bpp, filtered.data());
+            else FilterRow<0>(pixels, columns, bpp, filtered.data());
+        };
+        for (size_t y = band * kTileSize; y < std::min((band + 1) * kTileSize, frame_buffer.height()); ++y) {
+            // magnified rows share their source rows with the previous output row
+            const UpscaleTap &row = rows[y];
+            if (row.first == lower_row) {
+                std::swap(upper, lower);
+                std::swap(upper_row, lower_row);
+            }
+            if (row.first != upper_row) {
+                filter_row(row.first, upper);
+                upper_row = row.first;
+            }
+            if (row.second != lower_row) {
+                filter_row(row.second, lower);
+                lower_row = row.second;
+            }
+            const std::uint8_t *top = upper.data(), *bottom = lower.data();
+            std::uint8_t *out = output.data();
+            const std::uint16_t weight = row.weight;
+            for (size_t i = 0; i < row_size; ++i) out[i] = Blend(top[i], bottom[i], weight);
+            color_buffer.SetRow(y, out);
+        }
+    });
+}
+
+void Renderer::ProcessVertices(TriangleBatch &batch, const size_t width, const size_t height, const float padding) {
+    const DrawState &state = *batch.state;
+    const Model &model = *state.model;
+    const IShader &shader = *state.shader;
+    batch.triangles.reserve((batch.face_end - batch.face_begin) * batch.instances.size());
+
+    {
+        PROFILE_SCOPE(VertexShading);
+        // fifo cache of the current instance, the triangles are ordered for it when the model is loaded
+        std::array<VertexCacheEntry, MeshOptimizer::kCacheSize> cache;
+        VertexCacheEntry *entries = cache.data();
+        for (const std::uint32_t instance : batch.instances) {
+            cache.fill({});
+            size_t cache_next = 0;
+            for (size_t face_index = batch.face_begin; face_index < batch.face_end; face_index++) {
+                const std::array<std::uint32_t, 3> indices = {model.index(face_index, 0), model.index(face_index, 1), model.index(face_index, 2)};
+                std::array<Vertex, 3> vertex_shader_output{};
+                for (const int vertex_index : {0, 1, 2}) {
+                    const std::uint32_t index = indices[vertex_index];
+                    const VertexCacheEntry *hit = std::find_if(entries, entries + MeshOptimizer::kCacheSize, [&](const VertexCacheEntry &entry) { return entry.index == index; });
+                    if (hit != entries + MeshOptimizer::kCacheSize) {
+                        vertex_shader_output[vertex_index] = hit->vertex;
+                        continue;
+                    }
+                    const MeshVertex vertex = model.mesh_vertex(index); // decoded here for quantized models
+                    VertexShaderInput vertex_shader_input {
+                        .vertex_model_space = vertex.position,
+                        .normal = vertex.normal,
+                        .uv = vertex.uv,
+                        .instance = state.instances[instance],
+                        .state = state
+                    };
+                    shader.VertexShader(vertex_shader_input, vertex_shader_output[vertex_index]);
+                    entries[cache_next] = {index, vertex_shader_output[vertex_index]};
+                    cache_next = (cache_next + 1) % MeshOptimizer::kCacheSize;
+                }
+                batch.triangles.push_back(vertex_shader_output);
+            }
+        }
+    }
+    PROFILE_COUNT(TrianglesSubmitted, batch.triangles.size());
+
+    // bin the triangles by the tiles their bounding box overlaps (counting sort, keeps triangle order inside a tile)
+    const size_t tiles_x = (width + kTileSize - 1) / kTileSize;
+    const size_t tiles_y = (height + kTileSize - 1) / kTileSize;
+    PROFILE_SCOPE(PrimitiveAssembly);
+    batch.bin_offsets.assign(tiles_x * tiles_y + 1, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (std::uint32_t i = 0; i < batch.triangles.size(); ++i) {
+            Vector2s box_min, box_max;
+            if (!GetScreenBounds(batch.triangles[i], width, height, box_min, box_max, padding)) {
+                PROFILE_COUNT(TrianglesCulled, pass == 0);
+                continue;
+            }
+            PROFILE_COUNT(TrianglesBinned, pass == 0);
+            for (size_t ty = box_min[1] / kTileSize; ty <= box_max[1] / kTileSize; ++ty) {
+                for (size_t tx = box_min[0] / kTileSize; tx <= box_max[0] / kTileSize; ++tx) {
+                    if (pass == 0) batch.bin_offsets[ty * tiles_x + tx + 1]++;
+                    else batch.bin_triangles[batch.bin_offsets[ty * tiles_x + tx]++] = i;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (size_t t = 1; t < batch.bin_offsets.size(); ++t) batch.bin_offsets[t] += batch.bin_offsets[t - 1];
+            batch.bin_triangles.resize(batch.bin_offsets.back());
+        } else {
+            // the fill pass advanced every offset to the end of its bin, shift them back
+            for (size_t t = batch.bin_offsets.size() - 1; t > 0; --t) batch.bin_offsets[t] = batch.bin_offsets[t - 1];
+            batch.bin_offsets[0] = 0;
         }
-        RasterizeTriangle(vertex_shader_output, shader, frame_buffer, g_buffer, render_path);
     }
 }
 
 void Renderer::RasterizeTriangle(const std::array<Vertex, 3> &triangle,
-                                 const IShader &shader,
+                                 const DrawState &state,
                                  const FrameBuffer &frame_buffer,
                                  const GBuffer &g_buffer,
-                                 const RenderPath &render_path) {
-    // create bounding box
-    Vector2s box_min = {std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max()};
-    Vector2s box_max = {std::numeric_limits<size_t>::min(), std::numeric_limits<size_t>::min()};
-    for (const auto &vertex : triangle) {
-        box_min[0] = std::min(box_min[0], static_cast<size_t>(vertex.vertex_screen_space[0]));
-        box_min[1] = std::min(box_min[1], static_cast<size_t>(vertex.vertex_screen_space[1]));
-        box_max[0] = std::max(box_max[0], static_cast<size_t>(vertex.vertex_screen_space[0]));
-        box_max[1] = std::max(box_max[1], static_cast<size_t>(vertex.vertex_screen_space[1]));
+                                 const RenderPath &render_path,
+                                 const Vector2s &tile_min,
+                                 const Vector2s &tile_max) {
+    if (frame_buffer.multisample != nullptr) {
+        RasterizeTriangleMultisample(triangle, state, frame_buffer, g_buffer, render_path, tile_min, tile_max);
+        return;
     }
-    // ensure bounding box is within the frame buffer
-    box_min[0] = std::max(box_min[0], static_cast<size_t>(0));
-    box_min[1] = std::max(box_min[1], static_cast<size_t>(0));
-    box_max[0] = std::min(box_max[0], frame_buffer.width() - 1);
-    box_max[1] = std::min(box_max[1], frame_buffer.height() - 1);
-
-#pragma omp parallel for
-    for (size_t x = box_min[0]; x <= box_max[0]; x++) {
-        for (size_t y = box_min[1]; y <= box_max[1]; y++) {
+    // create bounding box, restricted to the current tile
+    Vector2s box_min, box_max;
+    if (!GetScreenBounds(triangle, frame_buffer.render_width(), frame_buffer.render_height(), box_min, box_max)) return;
+    box_min[0] = std::max(box_min[0], tile_min[0]);
+    box_min[1] = std::max(box_min[1], tile_min[1]);
+    box_max[0] = std::min(box_max[0], tile_max[0]);
+    box_max[1] = std::min(box_max[1], tile_max[1]);
+    if (box_min[0] > box_max[0] || box_min[1] > box_max[1]) return;
+
+    const VectorBuffer<2> *overdraw = g_buffer.overdraw.get();
+    for (size_t y = box_min[1]; y <= box_max[1]; y++) {
+        for (size_t x = box_min[0]; x <= box_max[0]; x++) {
             const Vector3f bc_screen = GetBarycentric2d(triangle, {static_cast<float>(x), static_cast<float>(y)});
             if (bc_screen[0] < 0 || bc_screen[1] < 0 || bc_screen[2] < 0) continue; // triangle test
             // inside the triangle
@@ -83,14 +381,27 @@ void Renderer::RasterizeTriangle(const std::array<Vertex, 3> &triangle,
             const float depth = triangle[0].vertex_clip_space[2] * bc_clip[0] +
                                 triangle[1].vertex_clip_space[2] * bc_clip[1] +
                                 triangle[2].vertex_clip_space[2] * bc_clip[2];
-            if (depth > frame_buffer.depth_buffer.Get(x, y)) continue; // depth test
+            const bool depth_passed = depth <= frame_buffer.depth_buffer.Get(x, y);
+            if (overdraw != nullptr) overdraw->Set(x, y, overdraw->Get(x, y) + Vector2f{1, depth_passed ? 1.0f : 0.0f});
+            if (!depth_passed) { // depth test
+                PROFILE_COUNT(DepthFail, 1);
+                continue;
+            }
+            PROFILE_COUNT(DepthPass, 1);
             frame_buffer.depth_buffer.Set(x, y, depth);
             // depth test passed
             FragmentShaderOutput out;
-            if (!shader.Fragment({
-                .triangle = triangle,
-                .bc_clip = bc_clip
-            }, out)) continue; // fragment shader test
+            bool shaded;
+            {
+                PROFILE_SCOPE_ACCUMULATE(FragmentShading);
+                shaded = state.shader->Fragment({
+                    .triangle = triangle,
+                    .bc_clip = bc_clip,
+                    .state = state
+                }, out);
+            }
+            PROFILE_COUNT(FragmentsShaded, 1);
+            if (!shaded) continue; // fragment shader test
             // fragment shader passed
             frame_buffer.color_buffer.SetPixel(x, y, out.color);
             if (render_path == DEFERRED) g_buffer.normal.Set(x, y, out.normal);
@@ -98,6 +409,111 @@ void Renderer::RasterizeTriangle(const std::array<Vertex, 3> &triangle,
     }
 }
 
+void Renderer::RasterizeTriangleMultisample(const std::array<Vertex, 3> &triangle,
+                                            const DrawState &state,
+                                            const FrameBuffer &frame_buffer,
+                                            const GBuffer &g_buffer,
+                                            const RenderPath &render_path,
+                                            const Vector2s &tile_min,
+                                            const Vector2s &tile_max) {
+    const MultisampleBuffer &multisample = *frame_buffer.multisample;
+    Vector2s box_min, box_max;
+    if (!GetScreenBounds(triangle, frame_buffer.render_width(), frame_buffer.render_height(), box_min, box_max, kSamplePadding)) return;
+    box_min[0] = std::max(box_min[0], tile_min[0]);
+    box_min[1] = std::max(box_min[1], tile_min[1]);
+    box_max[0] = std::min(box_max[0], tile_max[0]);
+    box_max[1] = std::min(box_max[1], tile_max[1]);
+    if (box_min[0] > box_max[0] || box_min[1] > box_max[1]) return;
+
+    // screen barycentrics are affine in x and y, set up once instead of solving them for every sample
+    const float x0 = triangle[0].vertex_screen_space[0], y0 = triangle[0].vertex_screen_space[1];
+    const float x1 = triangle[1].vertex_screen_space[0], y1 = triangle[1].vertex_screen_space[1];
+    const float x2 = triangle[2].vertex_screen_space[0], y2 = triangle[2].vertex_screen_space[1];
+    const float twice_area = x0 * (y1 - y2) + x1 * (y2 - y0) + x2 * (y0 - y1);
+    if (std::abs(twice_area) < 1e-2) return; // degenerate, as in GetBarycentric2d
+    const Vector3f bc_dx = Vector3f{y1 - y2, y2 - y0, y0 - y1} / twice_area;
+    const Vector3f bc_dy = Vector3f{x2 - x1, x0 - x2, x1 - x0} / twice_area;
+    const Vector3f bc_origin = Vector3f{x1 * y2 - x2 * y1, x2 * y0 - x0 * y2, x0 * y1 - x1 * y0} / twice_area;
+    const Vector3f inverse_w = {1 / triangle[0].vertex_clip_space[3], 1 / triangle[1].vertex_clip_space[3], 1 / triangle[2].vertex_clip_space[3]};
+    const Vector3f clip_z = {triangle[0].vertex_clip_space[2], triangle[1].vertex_clip_space[2], triangle[2].vertex_clip_space[2]};
+    const auto perspective_correct = [&](const Vector3f &bc) {
+        const Vector3f bc_clip = {bc[0] * inverse_w[0], bc[1] * inverse_w[1], bc[2] * inverse_w[2]};
+        return bc_clip / (bc_clip[0] + bc_clip[1] + bc_clip[2]);
+    };
+    const auto is_inside = [](const Vector3f &bc) { return bc[0] >= 0 && bc[1] >= 0 && bc[2] >= 0; };
+
+    const size_t samples = multisample.samples();
+    const Vector2f *positions = multisample.sample_positions();
+    const VectorBuffer<2> *overdraw = g_buffer.overdraw.get();
+    for (size_t y = box_min[1]; y <= box_max[1]; y++) {
+        for (size_t x = box_min[0]; x <= box_max[0]; x++) {
+            const Vector3f bc_pixel = bc_origin + bc_dx * static_cast<float>(x) + bc_dy * static_cast<float>(y);
+            std::uint32_t covered = 0, passed = 0;
+            Vector3f bc_covered = {0, 0, 0};
+            std::array<float, MultisampleBuffer::kMaxSamples> sample_depths;
+            float *depths = nullptr; // only fetched for covered pixels, fetching fills a lazily cleared tile
+            for (size_t s = 0; s < samples; ++s) {
+                const Vector3f bc = bc_pixel + bc_dx * positions[s][0] + bc_dy * positions[s][1];
+                if (!is_inside(bc)) continue; // coverage test
+                covered |= 1u << s;
+                bc_covered = bc_covered + bc;
+                sample_depths[s] = clip_z * perspective_correct(bc);
+                if (depths == nullptr) depths = multisample.depths(x, y);
+                if (sample_depths[s] <= depths[s]) passed |= 1u << s; // depth test
+            }
+            if (covered == 0) continue;
+            if (overdraw != nullptr) overdraw->Set(x, y, overdraw->Get(x, y) + Vector2f{1, passed != 0 ? 1.0f : 0.0f});
+            if (passed == 0) {
+                PROFILE_COUNT(DepthFail, 1);
+                continue;
+            }
+            PROFILE_COUNT(DepthPass, 1);
+            for (size_t s = 0; s < samples; ++s)
+                if (passed & 1u << s) depths[s] = sample_depths[s];
+
+            // shade at the pixel position, or at the centroid of the covered samples when the triangle misses it,
+            // attributes are never extrapolated past the edges
+            Vector3f bc_clip = perspective_correct(is_inside(bc_pixel) ? bc_pixel : bc_covered / static_cast<float>(std::popcount(covered)));
+            FragmentShaderOutput out;
+            bool shaded;
+            {
+                PROFILE_SCOPE_ACCUMULATE(FragmentShading);
+                shaded = state.shader->Fragment({
+                    .triangle = triangle,
+                    .bc_clip = bc_clip,
+                    .state = state
+                }, out);
+            }
+            PROFILE_COUNT(FragmentsShaded, 1);
+            if (!shaded) continue;
+            multisample.pixel(x, y)->Write(passed, out.color, samples);
+            if (render_path == DEFERRED) g_buffer.normal.Set(x, y, out.normal);
+        }
+    }
+}
+
+bool Renderer::GetScreenBounds(const std::array<Vertex, 3> &triangle, const size_t width, const size_t height, Vector2s &box_min, Vector2s &box_max,
+                               const float padding) {
+    float min_x = std::numeric_limits<float>::max(), min_y = std::numeric_limits<float>::max();
+    float max_x = std::numeric_limits<float>::lowest(), max_y = std::numeric_limits<float>::lowest();
+    for (const auto &vertex : triangle) {
+        if (!std::isfinite(vertex.vertex_screen_space[0]) || !std::isfinite(vertex.vertex_screen_space[1])) return false;
+        min_x = std::min(min_x, vertex.vertex_screen_space[0]);
+        min_y = std::min(min_y, vertex.vertex_screen_space[1]);
+        max_x = std::max(max_x, vertex.vertex_screen_space[0]);
+        max_y = std::max(max_y, vertex.vertex_screen_space[1]);
+    }
+    min_x -= padding;
+    min_y -= padding;
+    max_x += padding;
+    max_y += padding;
+    // ensure bounding box is within the frame buffer
+    if (max_x < 0 || max_y < 0 || min_x >= static_cast<float>(width) || min_y >= static_cast<float>(height)) return false;
+    box_min = {static_cast<size_t>(std::max(min_x, 0.0f)), static_cast<size_t>(std::max(min_y, 0.0f))};
+    box_max = {std::min(static_cast<size_t>(max_x), width - 1), std::min(static_cast<size_t>(max_y), height - 1)};
+    return true;
+}
+
 Vector3f Renderer::GetBarycentric2d(const std::array<Vertex, 3> &triangle, const Vector2f &p) {
     const float x0 = triangle[0].vertex_screen_space[0], y0 = triangle[0].vertex_screen_space[1];
     const float x1 = triangle[1].vertex_screen_space[0], y1 = triangle[1].vertex_screen_space[1];
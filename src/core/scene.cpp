@@ -1,33 +1,94 @@
 #include "scene.h"
+#include <algorithm>
+#include <cmath>
+#include "utility/allocation_counter.h"
 #include "utility/log.h"
 #include "renderer.h"
 
+namespace {
+    void CollectMeshObjects(const GameObject &game_obj, ArenaVector<const MeshObject*> &out) {
+        if (const auto mesh_obj = dynamic_cast<const MeshObject*>(&game_obj)) out.push_back(mesh_obj);
+        for (const auto& child : game_obj.children()) CollectMeshObjects(*child, out);
+    }
+}
+
 void Scene::Render() const {
     if (!CanRender()) {
         LOG_ERROR("Scene - scene are not ready to render");
         return;
     }
+    ALLOCATION_FRAME_SCOPE();
+
+    // nothing of the previous frame is alive anymore, its transient data is released at once
+    frame_arena_.Reset();
+    UpdateTransforms();
+    ArenaVector<const MeshObject*> visible_objs{ArenaAllocator<const MeshObject*>(&frame_arena_)};
+    for (const auto& mesh_obj : mesh_objs) CollectMeshObjects(*mesh_obj, visible_objs);
 
-    auto& shader = shader_list[current_shader_index];
-    shader->view_matrix = camera_obj->GetViewMatrix();
-    shader->projection_matrix = camera_obj->GetProjectionMatrix();
-    shader->viewport_matrix = frame_buffer->GetViewportMatrix();
-    shader->lights = lights;
-    shader->NormalizeLights();
-    for (const auto& mesh_obj : mesh_objs) {
+    const auto get_render_size = [this](const size_t size) {
+        return std::clamp<size_t>(static_cast<size_t>(std::lround(static_cast<float>(size) * resolution_scale)), 1, size);
+    };
+    frame_buffer->SetRenderSize(get_render_size(frame_buffer->width()), get_render_size(frame_buffer->height()));
+
+    // snapshot of the frame state, draws only read from it. it is reused once no draw holds it anymore
+    if (frame_state_ == nullptr || frame_state_.use_count() > 1) frame_state_ = std::make_shared<FrameState>();
+    const std::shared_ptr<FrameState> &frame = frame_state_;
+    frame->view_matrix = camera_obj->GetViewMatrix();
+    frame->projection_matrix = camera_obj->GetProjectionMatrix();
+    frame->viewport_matrix = frame_buffer->GetViewportMatrix();
+    frame->lights = lights;
+    frame->NormalizeLights();
+    frame->view_direction = camera_obj->GetViewDirection();
+
+    // record the draws, static objects are replayed from the previous frames
+    const auto& shader = shader_list[current_shader_index];
+    const bool record_static = static_commands_dirty_ || static_commands_shader_ != shader;
+    if (record_static) static_commands_.Clear();
+    dynamic_commands_.Clear();
+    bool static_loading = false;
+    for (const auto& mesh_obj : visible_objs) {
+        if (mesh_obj->is_static && !record_static) continue;
         if (mesh_obj->mesh == nullptr) {
             LOG_ERROR("Scene - mesh object has no mesh");
             continue;
         }
-        shader->model_matrix = mesh_obj->GetModelMatrix();
-        shader->view_direction = camera_obj->GetViewDirection();
-        shader->model = mesh_obj->mesh->model();
-        Renderer::DrawModel(*mesh_obj->mesh->model(), *shader, *frame_buffer, *g_buffer, render_path);
+        // objects still loading draw their placeholder, static ones are recorded again once they are loaded
+        static_loading |= mesh_obj->is_static && mesh_obj->mesh->is_loading();
+        const std::shared_ptr<Model> model = mesh_obj->mesh->model();
+        if (model == nullptr) {
+            if (!mesh_obj->mesh->is_loading()) LOG_ERROR("Scene - mesh object has no mesh");
+            continue;
+        }
+        auto& commands = mesh_obj->is_static ? static_commands_ : dynamic_commands_;
+        commands.Record(model, shader, mesh_obj->GetModelMatrix());
     }
-    if (render_path == DEFERRED) { shader->Deferred(*g_buffer, *frame_buffer); }
+    static_commands_shader_ = shader;
+    static_commands_dirty_ = static_loading;
+
+    // sort front-to-back inside shader/material groups, then merge into instanced draws
+    static_commands_.Sort(frame->view_matrix);
+    dynamic_commands_.Sort(frame->view_matrix);
+    ArenaVector<DrawState> draws{ArenaAllocator<DrawState>(&frame_arena_)};
+    static_commands_.Build(frame, draws);
+    dynamic_commands_.Build(frame, draws);
+    g_buffer->EnableOverdraw(debug_view == OVERDRAW);
+    frame_buffer->SetSampleCount(msaa_samples);
+    Renderer::Submit(draws, *frame_buffer, *g_buffer, render_path, &frame_arena_);
+    Renderer::ResolveMultisample(*frame_buffer);
+    if (render_path == DEFERRED) { shader->Deferred(*frame, *g_buffer, *frame_buffer); }
+    if (debug_view == OVERDRAW) overdraw_stats_ = Renderer::DrawOverdrawHeatmap(*g_buffer, *frame_buffer, &frame_arena_);
+    Renderer::Upscale(*frame_buffer, &frame_arena_);
+}
+
+void Scene::UpdateTransforms() const {
+    ArenaVector<GameObject*> roots{ArenaAllocator<GameObject*>(&frame_arena_)};
+    roots.reserve(mesh_objs.size() + 1);
+    roots.push_back(camera_obj.get());
+    for (const auto& mesh_obj : mesh_objs) roots.push_back(mesh_obj.get());
+    GameObject::UpdateHierarchy(roots, &frame_arena_);
 }
 
-void Callbacks::OnKeyPressed(Win32Wnd *windows, const KeyCode keycode) {
+void Callbacks::OnKeyPressed(IWindow *windows, const KeyCode keycode) {
     const auto scene = static_cast<Scene*>(windows->GetUserData().get());
     if (scene == nullptr) {
         LOG_WARNING("Callbacks - cannot get scene object from user data");
@@ -36,30 +97,31 @@ void Callbacks::OnKeyPressed(Win32Wnd *windows, const KeyCode keycode) {
     const auto& camera = scene->camera_obj;
     switch (keycode) {
         case A:
-            camera->transform.position[0] += 0.1f;
+            camera->SetPosition(camera->GetPosition() + Vector3f{0.1f, 0, 0});
             break;
         case D:
-            camera->transform.position[0] -= 0.1f;
+            camera->SetPosition(camera->GetPosition() - Vector3f{0.1f, 0, 0});
             break;
         case W:
-            camera->transform.position[2] -= 0.1f;
+            camera->SetPosition(camera->GetPosition() - Vector3f{0, 0, 0.1f});
             break;
         case S:
-            camera->transform.position[2] += 0.1f;
+            camera->SetPosition(camera->GetPosition() + Vector3f{0, 0, 0.1f});
             break;
         case Q:
-            camera->transform.position[1] += 0.1f;
+            camera->SetPosition(camera->GetPosition() + Vector3f{0, 0.1f, 0});
             break;
         case E:
-            camera->transform.position[1] -= 0.1f;
+            camera->SetPosition(camera->GetPosition() - Vector3f{0, 0.1f, 0});
             break;
         case SPACE:
-            camera->transform.position = {0, 0.5, 5};
-            camera->transform.rotation = {0, 0, 0};
+            camera->SetPosition({0, 0.5, 5});
+            camera->SetRotation({0, 0, 0});
             for (auto& mesh_obj: scene->mesh_objs) {
-                mesh_obj->transform.position = {0, 0, 0};
-                mesh_obj->transform.rotation = {0, 0, 0};
+                mesh_obj->SetPosition({0, 0, 0});
+                mesh_obj->SetRotation({0, 0, 0});
             }
+            scene->InvalidateStaticCommands();
             break;
         case ESC:
             windows->CloseWnd();
@@ -67,11 +129,23 @@ void Callbacks::OnKeyPressed(Win32Wnd *windows, const KeyCode keycode) {
         case ENTER:
             scene->auto_rotate = !scene->auto_rotate;
             break;
+        case O:
+            scene->debug_view = scene->debug_view == OVERDRAW ? NONE : OVERDRAW;
+            break;
+        case C:
+            scene->capture_frames = !scene->capture_frames;
+            break;
+        case M:
+            scene->msaa_samples = scene->msaa_samples >= 8 ? 1 : scene->msaa_samples * 2;
+            break;
+        case V:
+            scene->dynamic_resolution = !scene->dynamic_resolution;
+            break;
         default: break;
     }
 }
 
-void Callbacks::OnMousePressed(const Win32Wnd *windows, const MouseCode mousecode) {
+void Callbacks::OnMousePressed(const IWindow *windows, const MouseCode mousecode) {
     const auto scene = static_cast<Scene*>(windows->GetUserData().get());
     if (scene == nullptr) {
         LOG_WARNING("Callbacks - cannot get scene object from user data");
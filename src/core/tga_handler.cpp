@@ -1,23 +1,162 @@
 #include "tga_handler.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
 #include <fstream>
+#include <vector>
 #include "utility/log.h"
+#include "utility/mapped_file.h"
+#include "utility/thread_pool.h"
 
-std::unique_ptr<ColorBuffer> TGAHandler::ReadTGAFile(const std::string &filename) {
-    // open file
-    std::ifstream in;
-    in.open(filename, std::ios::binary);
-    if (!in.is_open()) {
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define HMXS_TGA_SSE2
+#endif
+
+namespace {
+    constexpr size_t kDecodeChunkPixels = 1 << 16; // pixels per decode task
+
+    /**
+     * @brief start of a range of whole packets decoded by one task, the last split marks the end of the data.
+     */
+    struct RLESplit {
+        size_t source;
+        size_t pixel;
+    };
+
+    // 3 byte pixels are widened to 4 bytes with a zero pad, the alpha GetPixel reports for 24 bit buffers
+    void CopyPixels(const std::uint8_t *src, std::uint8_t *dst, const size_t count, const std::uint8_t src_bpp, const std::uint8_t dst_bpp) {
+        if (src_bpp == dst_bpp) {
+            std::memcpy(dst, src, count * src_bpp);
+            return;
+        }
+        for (size_t i = 0; i < count; ++i, src += 3, dst += 4) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = 0;
+        }
+    }
+
+    void FillPixels(const std::uint8_t *pixel, std::uint8_t *dst, const size_t count, const std::uint8_t src_bpp, const std::uint8_t dst_bpp) {
+        if (dst_bpp == GRAYSCALE) {
+            std::memset(dst, pixel[0], count);
+            return;
+        }
+        std::uint8_t pattern[4] = {pixel[0], pixel[1], pixel[2], src_bpp == RGBA ? pixel[3] : std::uint8_t{0}};
+        if (dst_bpp == RGBA) {
+            std::uint32_t value;
+            std::memcpy(&value, pattern, sizeof(value));
+            for (size_t i = 0; i < count; ++i) std::memcpy(dst + i * 4, &value, sizeof(value));
+        } else {
+            for (size_t i = 0; i < count; ++i) std::memcpy(dst + i * 3, pattern, 3);
+        }
+    }
+
+    // walks the packet headers only, validates every packet and splits the data into ranges of about kDecodeChunkPixels
+    bool ScanRLE(const std::uint8_t *data, const size_t size, const size_t pixels_count, const std::uint8_t bpp, std::vector<RLESplit> &splits) {
+        size_t source = 0, pixel = 0;
+        splits.push_back({0, 0});
+        while (pixel < pixels_count) {
+            if (source >= size) {
+                LOG_ERROR("RLE - an error occurred while reading the frame_data");
+                return false;
+            }
+            const std::uint8_t chunk_header = data[source];
+            const size_t count = (chunk_header & 0x7F) + 1;
+            const size_t payload = chunk_header < 128 ? count * bpp : bpp;
+            if (size - source - 1 < payload) {
+                LOG_ERROR("RLE - an error occurred while reading the frame_data");
+                return false;
+            }
+            if (pixel + count > pixels_count) {
+                LOG_ERROR("RLE - too many pixels were read");
+                return false;
+            }
+            source += 1 + payload;
+            pixel += count;
+            if (pixel < pixels_count && pixel - splits.back().pixel >= kDecodeChunkPixels) splits.push_back({source, pixel});
+        }
+        splits.push_back({source, pixels_count});
+        return true;
+    }
+
+    // number of leading pixels equal to their successor, at most count. the count + 1 pixels at p must be readable
+    size_t CountEqualPairs(const std::uint8_t *p, const size_t count, const std::uint8_t bpp) {
+        // pixel i equals pixel i + 1 for every i < k exactly when the first k * bpp bytes equal the bytes bpp further on
+        const size_t bytes = count * bpp;
+        size_t i = 0;
+#ifdef HMXS_TGA_SSE2
+        for (; i + 16 <= bytes; i += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + bpp));
+            const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+            if (mask != 0xFFFF) return (i + std::countr_one(mask)) / bpp;
+        }
+#endif
+        while (i < bytes && p[i] == p[i + bpp]) ++i;
+        return i / bpp;
+    }
+
+    // number of leading pixels that differ from their successor, at most count. the count + 1 pixels at p must be readable
+    size_t CountDifferentPairs(const std::uint8_t *p, const size_t count, const std::uint8_t bpp) {
+        size_t i = 0;
+#ifdef HMXS_TGA_SSE2
+        if (bpp == RGBA) {
+            for (; i + 4 <= count; i += 4) {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 4));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 4 + 4));
+                const auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))));
+                if (mask != 0) return i + std::countr_zero(mask);
+            }
+        } else if (bpp == GRAYSCALE) {
+            for (; i + 16 <= count; i += 16) {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 1));
+                const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+                if (mask != 0) return i + std::countr_zero(mask);
+            }
+        }
+#endif
+        while (i < count && std::memcmp(p + i * bpp, p + (i + 1) * bpp, bpp) != 0) ++i;
+        return i;
+    }
+
+    void DecodeRLE(const std::uint8_t *data, const RLESplit &begin, const RLESplit &end, const std::uint8_t bpp, std::uint8_t *pixels, const std::uint8_t dst_bpp) {
+        size_t source = begin.source;
+        std::uint8_t *out = pixels + begin.pixel * dst_bpp;
+        for (size_t pixel = begin.pixel; pixel < end.pixel;) {
+            const std::uint8_t chunk_header = data[source++];
+            const size_t count = (chunk_header & 0x7F) + 1;
+            if (chunk_header < 128) {
+                CopyPixels(data + source, out, count, bpp, dst_bpp);
+                source += count * bpp;
+            } else {
+                FillPixels(data + source, out, count, bpp, dst_bpp);
+                source += bpp;
+            }
+            out += count * dst_bpp;
+            pixel += count;
+        }
+    }
+}
+
+std::unique_ptr<ColorBuffer> TGAHandler::ReadTGAFile(const std::string &filename, const bool pad_rgb) {
+    // the whole file is mapped, pixels are decoded straight from memory
+    MappedFile file(filename);
+    if (!file.is_open()) {
         LOG_ERROR("TGAReader - cannot open file: " + filename);
         return nullptr;
     }
 
     // read header
     TGAHeader header;
-    in.read(reinterpret_cast<char *>(&header), sizeof(header));
-    if (!in.good()) {
+    if (file.size() < sizeof(header)) {
         LOG_ERROR("TGAReader - cannot read the TGA header");
         return nullptr;
     }
+    std::memcpy(&header, file.data(), sizeof(header));
 
     // load width & height & bpp from header
     const auto width = header.width;
@@ -28,31 +167,53 @@ std::unique_ptr<ColorBuffer> TGAHandler::ReadTGAFile(const std::string &filename
         return nullptr;
     }
 
-    auto buffer = std::make_unique<ColorBuffer>(width, height, bpp);
+    // the image id and an unused color map sit between the header and the pixels
+    const size_t offset = sizeof(header) + header.id_length + (header.color_map_type != 0 ? header.color_map_length * ((header.color_map_depth + 7) / 8) : 0);
+    if (offset > file.size()) {
+        LOG_ERROR("TGAReader - cannot read frame data");
+        return nullptr;
+    }
+    const auto *data = reinterpret_cast<const std::uint8_t *>(file.data()) + offset;
+    const size_t size = file.size() - offset;
+    const size_t pixels_count = static_cast<size_t>(width) * height;
+    const std::uint8_t dst_bpp = pad_rgb && bpp == RGB ? RGBA : bpp;
+    const bool uncompressed = header.data_type_code == 3 || header.data_type_code == 2;
+    if (uncompressed && size < pixels_count * bpp) {
+        LOG_ERROR("TGAReader - cannot read frame data");
+        return nullptr;
+    }
 
-    // read frame_data
-    if (header.data_type_code == 3 || header.data_type_code == 2) {
-        in.read(reinterpret_cast<char *>(buffer->data()), width * height * bpp);
-        if (!in.good()) {
-            LOG_ERROR("TGAReader - cannot read frame data");
-            return nullptr;
-        }
+    std::unique_ptr<ColorBuffer> buffer;
+    if (uncompressed && dst_bpp == bpp) {
+        // the pixels are used in place, the buffer is a view of the mapping and keeps it alive
+        const auto mapping = std::make_shared<MappedFile>(std::move(file));
+        buffer = std::make_unique<ColorBuffer>(data, width, height, bpp, static_cast<std::ptrdiff_t>(width) * bpp, mapping);
+    } else if (uncompressed) {
+        buffer = std::make_unique<ColorBuffer>(width, height, dst_bpp);
+        std::uint8_t *pixels = buffer->data();
+        const size_t chunks = (pixels_count + kDecodeChunkPixels - 1) / kDecodeChunkPixels;
+        ThreadPool::Instance().ParallelFor(0, chunks, [&](const size_t i) {
+            const size_t begin = i * kDecodeChunkPixels, count = std::min(kDecodeChunkPixels, pixels_count - begin);
+            CopyPixels(data + begin * bpp, pixels + begin * dst_bpp, count, bpp, dst_bpp);
+        });
     } else if (header.data_type_code == 10 || header.data_type_code == 11) {
-        if (!LoadRLE(in, *buffer)) {
+        // packets may cross rows, so the ranges are split at packet boundaries found by a cheap pre-scan
+        std::vector<RLESplit> splits;
+        if (!ScanRLE(data, size, pixels_count, bpp, splits)) {
             LOG_ERROR("TGAReader - cannot load RLE data");
             return nullptr;
         }
+        buffer = std::make_unique<ColorBuffer>(width, height, dst_bpp);
+        std::uint8_t *pixels = buffer->data();
+        ThreadPool::Instance().ParallelFor(0, splits.size() - 1, [&](const size_t i) {
+            DecodeRLE(data, splits[i], splits[i + 1], bpp, pixels, dst_bpp);
+        });
     } else {
         LOG_ERROR("TGAReader - unknown file format: " + std::to_string(header.data_type_code));
         return nullptr;
     }
 
-    if (buffer->size() <= 0) {
-        LOG_ERROR("TGAReader - buffer size is invalid");
-        return nullptr;
-    }
-
-    // flip or not
+    // the file's origin only changes the view of the pixels
     if (!(header.image_descriptor & 0x20))
         buffer->FlipVertically();
     if (header.image_descriptor & 0x10)
@@ -60,6 +221,18 @@ std::unique_ptr<ColorBuffer> TGAHandler::ReadTGAFile(const std::string &filename
     return buffer;
 }
 
+bool TGAHandler::WriteTGAFile(const std::string &filename, const ColorBuffer &buffer, const bool v_flip, const bool rle) {
+    const int width = static_cast<int>(buffer.width()), height = static_cast<int>(buffer.height());
+    if (buffer.is_contiguous())
+        return WriteTGAFile(filename, width, height, buffer.bpp(), buffer.data(), v_flip, rle);
+    // packed bottom-up rows are written in place with the opposite origin flag, other views are packed first
+    if (buffer.pixel_stride() == buffer.bpp() && buffer.row_stride() == -static_cast<std::ptrdiff_t>(buffer.width() * buffer.bpp()) && height > 0)
+        return WriteTGAFile(filename, width, height, buffer.bpp(), buffer.row(height - 1), !v_flip, rle);
+    std::vector<std::uint8_t> packed(buffer.size());
+    buffer.CopyTo(packed.data());
+    return WriteTGAFile(filename, width, height, buffer.bpp(), packed.data(), v_flip, rle);
+}
+
 bool TGAHandler::WriteTGAFile(const std::string &filename, const int width, const int height, const std::uint8_t bpp, const std::uint8_t *data, const bool v_flip, const bool rle) {
     constexpr std::uint8_t developer_area_ref[4] = {0, 0, 0, 0};
     constexpr std::uint8_t extension_area_ref[4] = {0, 0, 0, 0};
@@ -83,39 +256,23 @@ bool TGAHandler::WriteTGAFile(const std::string &filename, const int width, cons
     header.data_type_code = bpp == GRAYSCALE ? (rle ? 11 : 3) : rle ? 10 : 2;
     header.image_descriptor = v_flip ? 0x00 : 0x20; // top-left or bottom-left origin
 
-    // write header
-    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
-    if (!out.good()) {
-        LOG_ERROR("TGAWriter - cannot write the TGA header");
-        return false;
-    }
+    // the uncompressed data is written straight from the caller's buffer, rle data is encoded into memory first
+    std::vector<std::uint8_t> encoded;
+    if (rle) EncodeRLE(static_cast<size_t>(width), static_cast<size_t>(height), bpp, data, encoded);
+    const char *pixels = reinterpret_cast<const char *>(rle ? encoded.data() : data);
+    const size_t pixels_size = rle ? encoded.size() : static_cast<size_t>(width) * height * bpp;
 
-    // write img
-    if (!rle) {
-        out.write(reinterpret_cast<const char *>(data), width * height * bpp);
-        if (!out.good()) {
-            LOG_ERROR("TGAWriter - cannot write the TGA data");
-            return false;
-        }
-    } else if (!UnloadRLE(out, width, height, bpp, data)) {
-        LOG_ERROR("TGAWriter - cannot unload RLE data");
-        return false;
-    }
-    out.write(reinterpret_cast<const char *>(developer_area_ref), sizeof(developer_area_ref));
-    if (!out.good()) {
-        LOG_ERROR("TGAWriter - cannot write the developer area ref");
-        return false;
-    }
-    out.write(reinterpret_cast<const char *>(extension_area_ref), sizeof(extension_area_ref));
-    if (!out.good()) {
-        LOG_ERROR("TGAWriter - cannot write the extension area ref");
-        return false;
-    }
+    std::array<std::uint8_t, sizeof(developer_area_ref) + sizeof(extension_area_ref) + sizeof(footer)> trailer {};
+    std::memcpy(trailer.data(), developer_area_ref, sizeof(developer_area_ref));
+    std::memcpy(trailer.data() + sizeof(developer_area_ref), extension_area_ref, sizeof(extension_area_ref));
+    std::memcpy(trailer.data() + sizeof(developer_area_ref) + sizeof(extension_area_ref), footer, sizeof(footer));
 
-    // write footer
-    out.write(reinterpret_cast<const char *>(footer), sizeof(footer));
-    if (!out.good()) {
-        LOG_ERROR("TGHandler - cannot write the footer");
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(pixels, static_cast<std::streamsize>(pixels_size));
+    out.write(reinterpret_cast<const char *>(trailer.data()), trailer.size());
+    out.close();
+    if (!out) {
+        LOG_ERROR("TGAWriter - cannot write the TGA data: " + filename);
         return false;
     }
 
@@ -123,87 +280,52 @@ bool TGAHandler::WriteTGAFile(const std::string &filename, const int width, cons
     return true;
 }
 
-bool TGAHandler::LoadRLE(std::ifstream &in, ColorBuffer &buffer) {
-    const size_t width = buffer.width(), height = buffer.height();
-    const std::uint8_t bpp = buffer.bpp();
-    const size_t pixels_count = width * height;
-    size_t current_pixel = 0;
-    size_t current_byte  = 0;
-    Color color_buffer;
-    do {
-        std::uint8_t chunk_header = in.get();
-        if (!in.good()) {
-            LOG_ERROR("RLE - an error occurred while reading the frame_data");
-            return false;
-        }
-        if (chunk_header < 128) {
-            chunk_header++;
-            for (int i = 0; i < chunk_header; i++) {
-                in.read(reinterpret_cast<char *>(color_buffer.bgra_array.data()), bpp);
-                if (!in.good()) {
-                    LOG_ERROR("RLE - an error occurred while reading the header");
-                    return false;
-                }
-                for (int t = 0; t < bpp; t++) buffer[current_byte++] = color_buffer.bgra_array[t];
-                current_pixel++;
-                if (current_pixel > pixels_count) {
-                    LOG_ERROR("RLE - too many pixels were read");
-                    return false;
-                }
-            }
-        } else {
-            chunk_header -= 127;
-            in.read(reinterpret_cast<char *>(color_buffer.bgra_array.data()), bpp);
-            if (!in.good()) {
-                LOG_ERROR("RLE - an error occurred while reading the header");
-                return false;
-            }
-            for (int i=0; i < chunk_header; i++) {
-                for (int t = 0; t < bpp; t++) buffer[current_byte++] = color_buffer.bgra_array[t];
-                current_pixel++;
-                if (current_pixel > pixels_count) {
-                    LOG_ERROR("RLE - too many pixels were read");
-                    return false;
-                }
-            }
-        }
-    } while (current_pixel < pixels_count);
-    return true;
+void TGAHandler::EncodeRLE(const size_t width, const size_t height, const std::uint8_t bpp, const std::uint8_t *data, std::vector<std::uint8_t> &out) {
+    // bands of whole rows are encoded independently and concatenated, packets never cross a band boundary
+    const size_t rows_per_band = std::max<size_t>(1, kEncodeBandPixels / std::max<size_t>(1, width));
+    const size_t bands = (height + rows_per_band - 1) / rows_per_band;
+    std::vector<std::vector<std::uint8_t>> encoded(bands);
+    ThreadPool::Instance().ParallelFor(0, bands, [&](const size_t band) {
+        const size_t begin = band * rows_per_band * width;
+        const size_t end = std::min(height, (band + 1) * rows_per_band) * width;
+        EncodeRLEBand(data, begin, end, bpp, encoded[band]);
+    });
+
+    size_t size = 0;
+    for (const auto &band : encoded) size += band.size();
+    out.resize(size);
+    size_t offset = 0;
+    for (const auto &band : encoded) {
+        std::memcpy(out.data() + offset, band.data(), band.size());
+        offset += band.size();
+    }
 }
 
-bool TGAHandler::UnloadRLE(std::ofstream &out, const int width, const int height, const std::uint8_t bpp, const std::uint8_t *data) {
-    const size_t pixels_count = width * height;
-    size_t current_pixel = 0;
-    while (current_pixel < pixels_count) {
-        const size_t chunk_start = current_pixel * bpp;
-        size_t current_byte = current_pixel * bpp;
-        std::uint8_t run_length = 1;
-        bool raw = true;
-        while (current_pixel + run_length < pixels_count && run_length < RLE_MAX_CHUNK_LENGTH) {
-            bool is_equal = true;
-            for (int t = 0; is_equal && t < bpp; t++) is_equal = data[current_byte + t] == data[current_byte + t + bpp];
-            current_byte += bpp;
-            if (run_length == 1)
-                raw = !is_equal;
-            if (raw && is_equal) {
-                run_length--;
-                break;
-            }
-            if (!raw && !is_equal)
-                break;
-            run_length++;
-        }
-        current_pixel += run_length;
-        out.put(static_cast<char>(raw ? run_length - 1 : run_length + 127));
-        if (!out.good()) {
-            LOG_ERROR("RLE - an error occurred while writing the header");
-            return false;
-        }
-        out.write(reinterpret_cast<const char *>(data + chunk_start), raw ? run_length * bpp : bpp);
-        if (!out.good()) {
-            LOG_ERROR("RLE - an error occurred while writing the frame_data");
-            return false;
+void TGAHandler::EncodeRLEBand(const std::uint8_t *data, const size_t begin, const size_t end, const std::uint8_t bpp, std::vector<std::uint8_t> &out) {
+    // worst case is a packet header for every other pixel
+    out.resize((end - begin) * (bpp + 1));
+    std::uint8_t *p = out.data();
+    size_t current_pixel = begin;
+    while (current_pixel < end) {
+        const std::uint8_t *pixel = data + current_pixel * bpp;
+        const size_t remaining = end - current_pixel;
+        const size_t pairs = std::min<size_t>(remaining - 1, RLE_MAX_CHUNK_LENGTH);
+        if (const size_t equal = std::min<size_t>(CountEqualPairs(pixel, pairs, bpp), RLE_MAX_CHUNK_LENGTH - 1); equal > 0) {
+            // run packet: one pixel repeated
+            *p++ = static_cast<std::uint8_t>(equal + 128);
+            std::memcpy(p, pixel, bpp);
+            p += bpp;
+            current_pixel += equal + 1;
+            continue;
         }
+        // raw packet: stops before the first pixel that starts a run
+        size_t length = CountDifferentPairs(pixel, pairs, bpp);
+        if (length == remaining - 1) length = remaining; // the last pixel of the band has no successor
+        length = std::min<size_t>(std::max<size_t>(length, 1), RLE_MAX_CHUNK_LENGTH);
+        *p++ = static_cast<std::uint8_t>(length - 1);
+        std::memcpy(p, pixel, length * bpp);
+        p += length * bpp;
+        current_pixel += length;
     }
-    return true;
+    out.resize(p - out.data());
 }
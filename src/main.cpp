@@ -1,9 +1,22 @@
 #include "utility/frame_timer.h"
 #include "utility/log.h"
+#include "utility/profiler.h"
+#include "utility/resolution_controller.h"
+#include "asset_manager.h"
+#include "frame_capture.h"
+#include "frame_pipeline.h"
 #include "scene.h"
+#ifdef _WIN32
+#include "platform/win32/win32_wnd.h"
+#else
+#include "platform/headless/headless_wnd.h"
+#endif
 
 constexpr int kWidth = 1024;
 constexpr int kHeigh = 1024;
+constexpr int kFrameQueueDepth = 3; // frames in flight, 1 renders, presents and clears sequentially
+constexpr int kCapturePoolSize = 4; // snapshots waiting to be written before frames are dropped
+constexpr double kTargetFrameTime = 1.0 / 30.0; // dynamic resolution lowers the render size to hold it
 
 Light light1 = {
     .direction = {1, 1, 1},
@@ -14,11 +27,11 @@ Light light2 = {
     .intensity = {1, 1, 1}
 };
 
-std::string GetUiText(const Scene &scene, const FrameTimer &timer) {
+std::string GetUiText(const Scene &scene, const FrameTimer &timer, const FrameCapture &capture, const ResolutionController &resolution) {
     std::ostringstream oss;
     oss << "INFO\n";
     oss << "Fps:     " << static_cast<int>(timer.fps()) << "\n";
-    oss << "Camera:  " << scene.camera_obj->transform.position << "\n";
+    oss << "Camera:  " << scene.camera_obj->GetPosition() << "\n";
     oss << "Models:  ";
     for (const auto &mesh_obj : scene.mesh_objs)
         oss << "\"" << mesh_obj->name << "\"  ";
@@ -33,11 +46,28 @@ std::string GetUiText(const Scene &scene, const FrameTimer &timer) {
         oss << direction << "  ";
     oss << "\n";
     oss << "Rotate:  " << (scene.auto_rotate ? "On" : "Off") << "\n";
+    oss << "MSAA:    " << (scene.msaa_samples > 1 ? std::to_string(scene.msaa_samples) + "x" : "Off") << "\n";
+    oss << "Scale:   " << (scene.dynamic_resolution ? "Dynamic" : "Off") << "  " << static_cast<int>(scene.resolution_scale * 100) << "%  "
+        << scene.frame_buffer->render_width() << " x " << scene.frame_buffer->render_height()
+        << "  target " << static_cast<int>(resolution.target_frame_time() * 1000) << " ms\n";
+    oss << "Capture: " << (scene.capture_frames ? "On" : "Off") << "  written " << capture.written() << "  dropped " << capture.dropped() << "\n";
+    if (scene.debug_view == OVERDRAW) {
+        const OverdrawStats &stats = scene.overdraw_stats();
+        oss << std::fixed << std::setprecision(2);
+        oss << "Overdraw: mean " << stats.mean_overdraw() << "  max " << stats.max_overdraw
+            << "  depth rejected " << stats.depth_rejected_percent() << "%\n";
+        oss << std::defaultfloat;
+    }
+    oss << PROFILE_FRAME_SUMMARY();
     oss << "\n";
     oss << "OPERATION\n";
     oss << "W A S D Q E - Move camera\n";
     oss << "   SPACE    - Reset models & camera\n";
     oss << "   ENTER    - Turn on/off rotation\n";
+    oss << "     O      - Turn on/off overdraw heatmap\n";
+    oss << "     C      - Turn on/off frame capture\n";
+    oss << "     M      - Switch MSAA off/2x/4x/8x\n";
+    oss << "     V      - Turn on/off dynamic resolution\n";
     oss << "Mouse Click - Switch Shader";
     return oss.str();
 }
@@ -51,9 +81,6 @@ int main() {
         "/african_head/african_head_eye_inner.obj",
     };
 
-    const auto frame_buffer = std::make_shared<FrameBuffer>(kWidth, kHeigh, RGBA);
-    const auto g_buffer = std::make_shared<GBuffer>(kWidth, kHeigh);
-
     const auto camera_obj = std::make_shared<CameraObject>();
     camera_obj->camera = Camera(40.0f, 1.0f, 0.1f, 1000.0f);
     camera_obj->SetPosition({0, 0.5, 5});
@@ -69,8 +96,6 @@ int main() {
 
     const auto scene = std::make_shared<Scene>();
     scene->camera_obj = camera_obj;
-    scene->frame_buffer = frame_buffer;
-    scene->g_buffer = g_buffer;
     // scene->shader_list.push_back(fixed_shader);
     // scene->shader_list.push_back(gray_shader);
     // scene->shader_list.push_back(phong_shader);
@@ -80,6 +105,7 @@ int main() {
     scene->shader_list.push_back(deferred_shader);
     scene->render_path = DEFERRED;
     scene->auto_rotate = false;
+    scene->dynamic_resolution = true;
 
     scene->lights.push_back(light1);
     scene->lights.push_back(light2);
@@ -88,35 +114,94 @@ int main() {
         const size_t last_dot = model_name.find_last_of('.');
         auto mesh_obj = std::make_shared<MeshObject>(model_name.substr(last_slash + 1, last_dot - last_slash - 1));
         const std::string model_path = std::string(ASSETS_PATH) + model_name;
-        mesh_obj->mesh = std::make_shared<Mesh>(model_path);
+        // models load on the thread pool, the window opens right away and they show up as they finish
+        mesh_obj->mesh = std::make_shared<Mesh>(AssetManager::Instance().LoadModelAsync(model_path));
         scene->mesh_objs.push_back(mesh_obj);
     }
 
+#ifdef _WIN32
     Win32Wnd window("Hmxs", "HmxsRenderer");
+#else
+    HeadlessWnd window("hmxs_frames.ring");
+#endif
     window.SetTextFont("mononoki", 20);
     window.SetUserData(scene);
-    window.RegisterKeyCallback(Callbacks::OnKeyPressed);
-    window.RegisterMouseCallback(Callbacks::OnMousePressed);
-
-    FrameTimer frame_timer;
+    // input arrives on the window thread and is applied on the render thread between frames, escape closes right away
+    std::mutex input_mutex;
+    std::vector<KeyCode> pending_keys;
+    std::vector<MouseCode> pending_buttons;
+    window.RegisterKeyCallback([&](IWindow *wnd, const KeyCode key_code) {
+        if (key_code == ESC) { wnd->CloseWnd(); return; }
+        std::lock_guard lock(input_mutex);
+        pending_keys.push_back(key_code);
+    });
+    window.RegisterMouseCallback([&](IWindow *, const MouseCode mouse_code) {
+        std::lock_guard lock(input_mutex);
+        pending_buttons.push_back(mouse_code);
+    });
 
     window.OpenWnd(kWidth, kHeigh);
-    while (window.is_running()) {
-        scene->Render();
-        window.PushBuffer(frame_buffer->color_buffer);
-        window.PushText(GetUiText(*scene, frame_timer));
-        window.UpdateWnd();
-        frame_buffer->Clear();
-        g_buffer->Clear();
-        Win32Wnd::HandleMsg();
-        frame_timer.Tick();
+    FramePipeline pipeline(kWidth, kHeigh, kFrameQueueDepth);
+    // frames render on their own thread while this thread, which owns the window, presents the previous one
+    std::thread render_thread([&] {
+        FrameTimer frame_timer;
+        // captured frames are encoded by a writer thread, frames are dropped rather than slowing the loop down
+        FrameCapture capture(kWidth, kHeigh, kCapturePoolSize, CAPTURE_DROP, "capture/frame_#####.tga");
+        ResolutionController resolution(kTargetFrameTime);
+        std::vector<KeyCode> keys;
+        std::vector<MouseCode> buttons;
+        while (FrameSlot *slot = pipeline.AcquireFrame()) {
+            {
+                std::lock_guard lock(input_mutex);
+                keys.swap(pending_keys);
+                buttons.swap(pending_buttons);
+            }
+            for (const KeyCode key_code : keys) Callbacks::OnKeyPressed(&window, key_code);
+            for (const MouseCode mouse_code : buttons) Callbacks::OnMousePressed(&window, mouse_code);
+            keys.clear();
+            buttons.clear();
 
-        if (scene->auto_rotate)
-        {
-            for (const auto& mesh_obj: scene->mesh_objs) {
-                mesh_obj->transform.rotation[1] += static_cast<float>(5.0 * frame_timer.delta_time());
+            scene->frame_buffer = slot->frame_buffer;
+            scene->g_buffer = slot->g_buffer;
+            scene->Render();
+            if (scene->capture_frames) capture.Capture(*slot->frame_buffer, slot->g_buffer.get());
+            {
+                PROFILE_SCOPE(UiText);
+                slot->ui_text = GetUiText(*scene, frame_timer, capture, resolution);
             }
+            pipeline.SubmitFrame(*slot);
+            PROFILE_FRAME_MARK();
+            frame_timer.Tick();
+            if (scene->dynamic_resolution) {
+                scene->resolution_scale = resolution.Update(frame_timer);
+            } else {
+                resolution.Reset();
+                scene->resolution_scale = 1.0f;
+            }
+
+            if (scene->auto_rotate)
+            {
+                for (const auto& mesh_obj: scene->mesh_objs) {
+                    mesh_obj->SetRotation(mesh_obj->GetRotation() + Vector3f{0, static_cast<float>(5.0 * frame_timer.delta_time()), 0});
+                }
+            }
+        }
+        capture.Flush();
+    });
+    while (window.is_running()) {
+        FrameSlot *slot = pipeline.AcquirePresent();
+        if (slot == nullptr) break;
+        {
+            PROFILE_SCOPE(Present);
+            window.PushBuffer(slot->frame_buffer->color_buffer);
+            window.PushText(slot->ui_text);
+            window.UpdateWnd();
         }
+        pipeline.ReleasePresent(*slot);
+        window.HandleMsg();
     }
+    pipeline.Close();
+    render_thread.join();
+    PROFILE_WRITE_TRACE("hmxs_trace.json");
     return 0;
 }
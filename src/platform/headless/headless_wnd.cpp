@@ -0,0 +1,123 @@
+#include "headless_wnd.h"
+#include <algorithm>
+#include <cassert>
+#include <csignal>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "utility/log.h"
+
+namespace {
+    volatile std::sig_atomic_t g_stop_requested = 0;
+
+    void OnStopSignal(int) { g_stop_requested = 1; }
+}
+
+HeadlessWnd::HeadlessWnd(std::string ring_path, const std::uint32_t slot_count)
+    : ring_path_(std::move(ring_path)), slot_count_(std::max(1u, slot_count)) {
+}
+
+HeadlessWnd::~HeadlessWnd() {
+    if (mapping_ != nullptr) munmap(mapping_, mapping_size_);
+    if (fd_ >= 0) close(fd_);
+}
+
+void HeadlessWnd::OpenWnd(const int width, const int height) {
+    assert(width > 0 && height > 0);
+    width_ = width;
+    height_ = height;
+
+    const size_t slot_stride = (sizeof(HeadlessSlotHeader) + static_cast<size_t>(width) * height * 4 + 63) & ~static_cast<size_t>(63);
+    mapping_size_ = sizeof(HeadlessRingHeader) + slot_stride * slot_count_;
+    fd_ = open(ring_path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(mapping_size_)) != 0) {
+        LOG_ERROR("HeadlessWnd - cannot create ring file: " + ring_path_);
+        return;
+    }
+    void* mapping = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("HeadlessWnd - cannot map ring file: " + ring_path_);
+        return;
+    }
+    mapping_ = static_cast<std::uint8_t*>(mapping);
+
+    const auto header = new (mapping_) HeadlessRingHeader();
+    header->width = width;
+    header->height = height;
+    header->slot_count = slot_count_;
+    header->slot_stride = slot_stride;
+    for (std::uint32_t i = 0; i < slot_count_; ++i) new (Slot(i)) HeadlessSlotHeader();
+
+    std::signal(SIGINT, OnStopSignal);
+    std::signal(SIGTERM, OnStopSignal);
+    is_running_ = true;
+    LOG_INFO("HeadlessWnd - presenting " + std::to_string(width) + " x " + std::to_string(height) + " into " + ring_path_);
+}
+
+void HeadlessWnd::PushBuffer(const ColorBuffer &buffer) {
+    assert(buffer.bpp() == ColorType::RGBA || buffer.bpp() == ColorType::GRAYSCALE || buffer.bpp() == ColorType::RGB);
+    if (mapping_ == nullptr) return;
+    HeadlessSlotHeader* slot = BeginWrite();
+    slot->frame_index = frame_;
+
+    uint8_t* pixel_ptr = reinterpret_cast<uint8_t*>(slot + 1);
+    const size_t pixel_count = std::min(buffer.width() * buffer.height(), static_cast<size_t>(width_) * height_);
+    if (buffer.bpp() == RGBA) {
+        std::copy_n(buffer.data(), pixel_count * 4, pixel_ptr);
+    } else if (buffer.bpp() == GRAYSCALE) {
+        const uint8_t* data = buffer.data();
+        for (size_t i = 0; i < pixel_count; ++i) {
+            pixel_ptr[0] = pixel_ptr[1] = pixel_ptr[2] = data[i];
+            pixel_ptr[3] = 255;
+            pixel_ptr += 4;
+        }
+    } else if (buffer.bpp() == RGB) {
+        const uint8_t* data = buffer.data();
+        for (size_t i = 0; i < pixel_count; ++i) {
+            pixel_ptr[0] = data[i * 3];
+            pixel_ptr[1] = data[i * 3 + 1];
+            pixel_ptr[2] = data[i * 3 + 2];
+            pixel_ptr[3] = 255;
+            pixel_ptr += 4;
+        }
+    }
+}
+
+void HeadlessWnd::PushText(const std::string &text) {
+    if (mapping_ == nullptr) return;
+    HeadlessSlotHeader* slot = BeginWrite();
+    const size_t length = std::min(text.size(), sizeof(slot->text) - 1);
+    std::memcpy(slot->text, text.data(), length);
+    slot->text[length] = '\0';
+}
+
+void HeadlessWnd::UpdateWnd() {
+    if (mapping_ == nullptr || !writing_) return;
+    Slot(frame_)->sequence.store(frame_ * 2 + 2, std::memory_order_release);
+    reinterpret_cast<HeadlessRingHeader*>(mapping_)->frame_count.store(frame_ + 1, std::memory_order_release);
+    writing_ = false;
+    frame_++;
+    if (frame_limit_ != 0 && frame_ >= frame_limit_) CloseWnd();
+}
+
+void HeadlessWnd::HandleMsg() {
+    if (g_stop_requested) CloseWnd();
+}
+
+HeadlessSlotHeader* HeadlessWnd::BeginWrite() {
+    HeadlessSlotHeader* slot = Slot(frame_);
+    if (!writing_) {
+        slot->sequence.store(frame_ * 2 + 1, std::memory_order_relaxed);
+        // keeps the slot contents written below from becoming visible before the odd sequence
+        std::atomic_thread_fence(std::memory_order_release);
+        writing_ = true;
+    }
+    return slot;
+}
+
+HeadlessSlotHeader* HeadlessWnd::Slot(const std::uint64_t frame) const {
+    const auto header = reinterpret_cast<const HeadlessRingHeader*>(mapping_);
+    return reinterpret_cast<HeadlessSlotHeader*>(mapping_ + sizeof(HeadlessRingHeader) + header->slot_stride * (frame % slot_count_));
+}
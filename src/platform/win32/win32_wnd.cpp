@@ -5,8 +5,7 @@
 Win32Wnd::Win32Wnd(const LPCSTR &class_name, const LPCSTR &window_title)
     : class_name_(class_name), window_title_(window_title), width_(0), height_(0), hinstance_(GetModuleHandle(nullptr)),
         hwnd_(nullptr), pixels_dc_(nullptr), pixels_buffer_(nullptr), pixel_bitmap_(nullptr), text_font_(nullptr),
-        text_dc_(nullptr), text_bitmap_(nullptr), text_size_({}), text_color_(RGB(255, 255, 255)), text_offset_({10, 10}),
-        is_running_(false), user_data_(nullptr) {
+        text_dc_(nullptr), text_bitmap_(nullptr), text_size_({}), text_color_(RGB(255, 255, 255)), text_offset_({10, 10}) {
     assert(hinstance_ != nullptr);
 }
 
@@ -28,7 +27,7 @@ void Win32Wnd::OpenWnd(const int width, const int height) {
     is_running_ = true;
 }
 
-void Win32Wnd::PushBuffer(const ColorBuffer &buffer) const {
+void Win32Wnd::PushBuffer(const ColorBuffer &buffer) {
     assert(buffer.bpp() == ColorType::RGBA || buffer.bpp() == ColorType::GRAYSCALE || buffer.bpp() == ColorType::RGB);
 
     if (buffer.bpp() == RGBA) {
@@ -72,17 +71,13 @@ void Win32Wnd::PushText(const std::string &text) {
     ReleaseDC(hwnd_, hdc);
 }
 
-void Win32Wnd::UpdateWnd() const {
+void Win32Wnd::UpdateWnd() {
     HDC hdc = GetDC(hwnd_);
     BitBlt(pixels_dc_, text_offset_[0], text_offset_[1], text_size_.cx, text_size_.cy, text_dc_, 0, 0, SRCCOPY);
     BitBlt(hdc, 0, 0, width_, height_, pixels_dc_, 0, 0, SRCCOPY);
     ReleaseDC(hwnd_, hdc);
 }
 
-void Win32Wnd::CloseWnd() {
-    is_running_ = false;
-}
-
 void Win32Wnd::SetTextFont(const std::string &font_name, const int font_size) {
     text_font_ = CreateFont(font_size, 0, 0, 0,
                             FW_NORMAL,
@@ -191,27 +186,22 @@ void Win32Wnd::ProcessKey(Win32Wnd* windows, const WPARAM wParam) {
         case 'S':       key_code = S;       break;
         case 'Q':       key_code = Q;       break;
         case 'E':       key_code = E;       break;
+        case 'O':       key_code = O;       break;
+        case 'C':       key_code = C;       break;
+        case 'M':       key_code = M;       break;
+        case 'V':       key_code = V;       break;
         case VK_SPACE:  key_code = SPACE;   break;
         case VK_RETURN: key_code = ENTER;   break;
         default:                            return;
     }
-    if (!windows->key_callbacks_.empty()) {
-        for (auto& callback: windows->key_callbacks_)
-            callback(windows, key_code);
-    }
+    windows->DispatchKey(key_code);
 }
 
 void Win32Wnd::ProcessMouse(Win32Wnd* windows, const MouseCode mouse_code) {
-    if (!windows->mouse_callbacks_.empty()) {
-        for (auto& callback: windows->mouse_callbacks_)
-            callback(windows, mouse_code);
-    }
+    windows->DispatchMouse(mouse_code);
 }
 
 void Win32Wnd::ProcessScroll(Win32Wnd* windows, const WPARAM wParam) {
     const double offset = GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA;
-    if (!windows->scroll_callbacks_.empty()) {
-        for (auto& callback: windows->scroll_callbacks_)
-            callback(windows, offset);
-    }
+    windows->DispatchScroll(offset);
 }
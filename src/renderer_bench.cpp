@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include "utility/log.h"
+#include "utility/thread_pool.h"
+#include "renderer.h"
+#include "scene.h"
+#include "tga_handler.h"
+
+/**
+ * renderer benchmarks, results are written as json so runs of different releases can be compared.
+ *
+ * usage: renderer_bench [--output file.json] [--repetitions N]
+ *
+ * every benchmark runs once to warm up and then N timed repetitions, inputs come from the bundled assets
+ * and from a fixed seed random generator so runs are reproducible.
+ */
+
+struct RendererBench {
+    static std::vector<std::array<Vertex, 3>> ShadeTriangles(const DrawState &state) {
+        static constexpr std::uint32_t kFirstInstance = 0;
+        Renderer::TriangleBatch batch;
+        batch.state = &state;
+        batch.instances = {&kFirstInstance, 1};
+        batch.face_end = state.model->faces_size();
+        Renderer::ProcessVertices(batch, 1, 1);
+        return {batch.triangles.begin(), batch.triangles.end()};
+    }
+
+    static void Rasterize(const std::array<Vertex, 3> &triangle, const DrawState &state, const FrameBuffer &frame_buffer, const GBuffer &g_buffer) {
+        Renderer::RasterizeTriangle(triangle, state, frame_buffer, g_buffer, FORWARD,
+                                    {0, 0}, {frame_buffer.width() - 1, frame_buffer.height() - 1});
+    }
+};
+
+namespace {
+    const std::string kHeadModel = std::string(ASSETS_PATH) + "/african_head/african_head.obj";
+    const std::string kEyeModel = std::string(ASSETS_PATH) + "/african_head/african_head_eye_inner.obj";
+    const std::string kDiffuseTexture = std::string(ASSETS_PATH) + "/african_head/african_head_diffuse.tga";
+
+    struct BenchResult {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> params{};
+        size_t items = 1;               // work items per repetition, e.g. triangles or pixels
+        std::vector<double> samples_ms{};
+    };
+
+    class BenchRunner {
+    public:
+        explicit BenchRunner(const size_t repetitions) : repetitions_(repetitions) { }
+
+        /**
+         * @brief times func, setup runs before every repetition and is not timed.
+         */
+        template<typename F, typename S = void(*)()>
+        void Run(const std::string &name, std::vector<std::pair<std::string, std::string>> params, const size_t items, F &&func, S &&setup = [] { }) {
+            BenchResult result {.name = name, .params = std::move(params), .items = items};
+            setup();
+            func();
+            for (size_t i = 0; i < repetitions_; ++i) {
+                setup();
+                const auto start = std::chrono::steady_clock::now();
+                func();
+                result.samples_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            std::ostringstream oss;
+            oss << std::fixed << std::setprecision(3) << "Bench - " << name;
+            for (const auto &[key, value] : result.params) oss << " " << key << "=" << value;
+            oss << ": " << Median(result.samples_ms) << " ms";
+            std::cerr << oss.str() << "\n";
+            results_.push_back(std::move(result));
+        }
+
+        void WriteJson(std::ostream &out) const {
+            out << std::setprecision(6) << "{\n  \"benchmark\": \"renderer_bench\",\n  \"format_version\": 1,\n"
+                << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+                << "  \"repetitions\": " << repetitions_ << ",\n  \"results\": [\n";
+            for (size_t i = 0; i < results_.size(); ++i) {
+                const auto &result = results_[i];
+                const double median = Median(result.samples_ms);
+                out << "    {\"name\": \"" << result.name << "\", \"params\": {";
+                for (size_t p = 0; p < result.params.size(); ++p)
+                    out << (p ? ", " : "") << "\"" << result.params[p].first << "\": \"" << result.params[p].second << "\"";
+                out << "}, \"items\": " << result.items
+                    << ", \"min_ms\": " << *std::min_element(result.samples_ms.begin(), result.samples_ms.end())
+                    << ", \"median_ms\": " << median
+                    << ", \"mean_ms\": " << std::accumulate(result.samples_ms.begin(), result.samples_ms.end(), 0.0) / static_cast<double>(result.samples_ms.size())
+                    << ", \"items_per_second\": " << (median > 0 ? static_cast<double>(result.items) * 1000.0 / median : 0.0)
+                    << "}" << (i + 1 < results_.size() ? "," : "") << "\n";
+            }
+            out << "  ]\n}\n";
+        }
+
+    private:
+        static double Median(std::vector<double> samples) {
+            std::sort(samples.begin(), samples.end());
+            return samples[samples.size() / 2];
+        }
+
+        size_t repetitions_;
+        std::vector<BenchResult> results_;
+    };
+
+    // keeps results of pure computations alive
+    volatile float g_sink = 0;
+
+    std::shared_ptr<FrameState> CreateFrameState(const size_t width, const size_t height) {
+        CameraObject camera_obj;
+        camera_obj.camera = Camera(40.0f, static_cast<float>(width) / static_cast<float>(height), 0.1f, 1000.0f);
+        camera_obj.SetPosition({0, 0.5, 5});
+        const auto frame = std::make_shared<FrameState>();
+        frame->view_matrix = camera_obj.GetViewMatrix();
+        frame->projection_matrix = camera_obj.GetProjectionMatrix();
+        frame->viewport_matrix = FrameBuffer::GetViewportMatrix(0, 0, width, height);
+        frame->lights = {{.direction = {1, 1, 1}, .intensity = {1, 1, 1}}, {.direction = {-1, -1, -1}, .intensity = {1, 1, 1}}};
+        frame->NormalizeLights();
+        frame->view_direction = camera_obj.GetViewDirection();
+        return frame;
+    }
+
+    DrawState CreateDrawState(const std::shared_ptr<const FrameState> &frame, const std::shared_ptr<const IShader> &shader, const std::shared_ptr<const Model> &model) {
+        model->WaitForTextures(shader->texture_slots); // the benchmarks time shading with every map loaded
+        return {.frame = frame, .shader = shader, .model = model,
+                .instances = {InstanceTransform::Create(Matrix4x4::Identity(), frame->view_matrix)}};
+    }
+
+    std::vector<std::shared_ptr<IShader>> CreateShaders() {
+        return {
+            std::make_shared<FixedShader>(),
+            std::make_shared<GrayShader>(),
+            std::make_shared<PhongShader>(),
+            std::make_shared<BlinnPhongShader>(),
+            std::make_shared<NormalShader>(),
+            std::make_shared<NormalTangentShader>(),
+            std::make_shared<DeferredShader>()
+        };
+    }
+
+    void BenchModel(BenchRunner &runner) {
+        const auto frame = CreateFrameState(1024, 1024);
+        for (const MeshFormat format : {FULL_PRECISION, QUANTIZED}) {
+            const std::string format_name = format == QUANTIZED ? "quantized" : "full";
+            runner.Run("model_load", {{"model", "african_head"}, {"format", format_name}}, 1, [format] {
+                const Model model(kHeadModel, format);
+                g_sink = g_sink + static_cast<float>(model.faces_size());
+            });
+
+            const auto model = std::make_shared<Model>(kHeadModel, format);
+            const DrawState state = CreateDrawState(frame, std::make_shared<GrayShader>(), model);
+            runner.Run("vertex_processing", {{"model", "african_head"}, {"format", format_name}}, model->faces_size(), [&] {
+                g_sink = g_sink + static_cast<float>(RendererBench::ShadeTriangles(state).size());
+            });
+        }
+    }
+
+    void BenchTGA(BenchRunner &runner) {
+        const auto texture = TGAHandler::ReadTGAFile(kDiffuseTexture);
+        const size_t pixels = texture->width() * texture->height();
+        runner.Run("tga_read", {{"image", "african_head_diffuse"}}, pixels, [] {
+            g_sink = g_sink + static_cast<float>(TGAHandler::ReadTGAFile(kDiffuseTexture)->width());
+        });
+
+        // a rendered frame has long runs of background, the texture has almost none
+        const FrameBuffer frame_buffer(1024, 1024);
+        const GBuffer g_buffer(1024, 1024);
+        const auto frame = CreateFrameState(1024, 1024);
+        const auto shader = std::make_shared<BlinnPhongShader>();
+        const auto model = std::make_shared<Model>(kHeadModel);
+        frame_buffer.Clear();
+        Renderer::DrawModel(CreateDrawState(frame, shader, model), frame_buffer, g_buffer, FORWARD);
+
+        const std::string path = (std::filesystem::temp_directory_path() / "renderer_bench.tga").string();
+        for (const bool rle : {false, true}) {
+            const std::string encoding = rle ? "rle" : "raw";
+            runner.Run("tga_write", {{"image", "african_head_diffuse"}, {"encoding", encoding}}, pixels, [&] {
+                TGAHandler::WriteTGAFile(path, *texture, false, rle);
+            });
+            runner.Run("tga_write", {{"image", "frame_1024"}, {"encoding", encoding}}, frame_buffer.width() * frame_buffer.height(), [&] {
+                TGAHandler::WriteTGAFile(path, 1024, 1024, RGBA, frame_buffer.color_buffer.data(), false, rle);
+            });
+            runner.Run("tga_read", {{"image", "frame_1024"}, {"encoding", encoding}}, frame_buffer.width() * frame_buffer.height(), [&] {
+                g_sink = g_sink + static_cast<float>(TGAHandler::ReadTGAFile(path)->width());
+            }, [&] { TGAHandler::WriteTGAFile(path, 1024, 1024, RGBA, frame_buffer.color_buffer.data(), false, rle); });
+        }
+        std::filesystem::remove(path);
+    }
+
+    void BenchMaths(BenchRunner &runner) {
+        constexpr size_t kCount = 1 << 16;
+        std::mt19937 random(1);
+        std::uniform_real_distribution distribution(-1.0f, 1.0f);
+        std::vector<Vector3f> vectors(kCount);
+        for (auto &vector : vectors) vector = {distribution(random), distribution(random), distribution(random) + 2.0f};
+        Matrix4x4 matrix = CreateFrameState(512, 512)->projection_matrix * CreateFrameState(512, 512)->view_matrix;
+
+        runner.Run("vector_dot", {}, kCount, [&] {
+            float sum = 0;
+            for (size_t i = 1; i < kCount; ++i) sum += vectors[i] * vectors[i - 1];
+            g_sink = g_sink + sum;
+        });
+        runner.Run("vector_cross", {}, kCount, [&] {
+            Vector3f sum;
+            for (size_t i = 1; i < kCount; ++i) sum = sum + Vector3f::Cross(vectors[i], vectors[i - 1]);
+            g_sink = g_sink + sum[0];
+        });
+        runner.Run("vector_normalize", {}, kCount, [&] {
+            Vector3f sum;
+            for (size_t i = 0; i < kCount; ++i) sum = sum + vectors[i].Normalize();
+            g_sink = g_sink + sum[0];
+        });
+        runner.Run("matrix_vector_mul", {{"size", "4x4"}}, kCount, [&] {
+            Vector4f sum;
+            for (size_t i = 0; i < kCount; ++i) sum = sum + matrix * vectors[i].Embed<4>(1);
+            g_sink = g_sink + sum[0];
+        });
+        runner.Run("matrix_mul", {{"size", "4x4"}}, kCount / 16, [&] {
+            Matrix4x4 product = Matrix4x4::Identity();
+            for (size_t i = 0; i < kCount / 16; ++i) product = matrix * product * 0.5f;
+            g_sink = g_sink + product[0][0];
+        });
+        runner.Run("matrix_inverse_transpose", {{"size", "4x4"}}, kCount / 64, [&] {
+            float sum = 0;
+            for (size_t i = 0; i < kCount / 64; ++i) {
+                matrix[0][3] = static_cast<float>(i);
+                sum += matrix.InverseTranspose()[0][0];
+            }
+            g_sink = g_sink + sum;
+        });
+    }
+
+    void BenchRasterize(BenchRunner &runner) {
+        constexpr size_t kSize = 1024;
+        const FrameBuffer frame_buffer(kSize, kSize);
+        const GBuffer g_buffer(kSize, kSize);
+        const auto frame = CreateFrameState(kSize, kSize);
+        const DrawState state = CreateDrawState(frame, std::make_shared<GrayShader>(), std::make_shared<Model>(kHeadModel));
+        const auto source = RendererBench::ShadeTriangles(state);
+
+        // equilateral triangles with random position and rotation, attributes are borrowed from the shaded model
+        for (const float edge : {2.0f, 8.0f, 32.0f, 128.0f, 512.0f}) {
+            const float area = edge * edge * 0.433f;
+            const size_t count = std::clamp<size_t>(static_cast<size_t>((1 << 22) / area), 64, 1 << 16);
+            std::mt19937 random(static_cast<unsigned>(edge));
+            std::uniform_real_distribution position(0.0f, static_cast<float>(kSize));
+            std::uniform_real_distribution angle(0.0f, 6.2831853f);
+            std::vector<std::array<Vertex, 3>> triangles(count);
+            for (size_t i = 0; i < count; ++i) {
+                triangles[i] = source[i % source.size()];
+                const Vector2f center = {position(random), position(random)};
+                const float theta = angle(random);
+                for (int v = 0; v < 3; ++v) {
+                    const float a = theta + static_cast<float>(v) * 2.0943951f;
+                    triangles[i][v].vertex_screen_space = center + Vector2f{std::cos(a), std::sin(a)} * (edge * 0.57735f);
+                }
+            }
+            runner.Run("rasterize_triangle", {{"edge_px", std::to_string(static_cast<int>(edge))}, {"shader", "Gray"}}, count, [&] {
+                for (const auto &triangle : triangles) RendererBench::Rasterize(triangle, state, frame_buffer, g_buffer);
+            }, [&] { frame_buffer.Clear(); frame_buffer.Resolve(); });
+        }
+    }
+
+    void BenchShaders(BenchRunner &runner) {
+        constexpr size_t kFragments = 1 << 16;
+        const auto frame = CreateFrameState(1024, 1024);
+        const auto model = std::make_shared<Model>(kHeadModel);
+        std::mt19937 random(2);
+        std::uniform_real_distribution distribution(0.0f, 1.0f);
+        std::vector<Vector3f> barycentrics(kFragments);
+        for (auto &bc : barycentrics) {
+            bc = {distribution(random), distribution(random), distribution(random)};
+            bc = bc / (bc[0] + bc[1] + bc[2]);
+        }
+
+        for (const auto &shader : CreateShaders()) {
+            const DrawState state = CreateDrawState(frame, shader, model);
+            const auto triangles = RendererBench::ShadeTriangles(state);
+            runner.Run("fragment", {{"shader", shader->name}}, kFragments, [&] {
+                FragmentShaderOutput out;
+                float sum = 0;
+                for (size_t i = 0; i < kFragments; ++i) {
+                    Vector3f bc_clip = barycentrics[i];
+                    shader->Fragment({.triangle = triangles[i % triangles.size()], .bc_clip = bc_clip, .state = state}, out);
+                    sum += out.color[0];
+                }
+                g_sink = g_sink + sum;
+            });
+        }
+
+        // deferred lighting of a g-buffer filled by a real frame
+        for (const size_t size : {512, 1024}) {
+            const FrameBuffer frame_buffer(size, size);
+            const GBuffer g_buffer(size, size);
+            const auto deferred_frame = CreateFrameState(size, size);
+            const auto shader = std::make_shared<DeferredShader>();
+            frame_buffer.Clear();
+            g_buffer.Clear();
+            Renderer::DrawModel(CreateDrawState(deferred_frame, shader, model), frame_buffer, g_buffer, DEFERRED);
+            runner.Run("deferred", {{"resolution", std::to_string(size)}}, size * size, [&] {
+                shader->Deferred(*deferred_frame, g_buffer, frame_buffer);
+            });
+        }
+    }
+
+    void BenchFrames(BenchRunner &runner) {
+        std::vector<size_t> thread_counts = {1, 2, 4, std::max(1u, std::thread::hardware_concurrency())};
+        std::sort(thread_counts.begin(), thread_counts.end());
+        thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+        const auto head = std::make_shared<Model>(kHeadModel);
+        const auto eye = std::make_shared<Model>(kEyeModel);
+
+        for (const size_t size : {256, 512, 1024}) {
+            for (const std::shared_ptr<IShader> &shader : {std::shared_ptr<IShader>(std::make_shared<BlinnPhongShader>()),
+                                                           std::shared_ptr<IShader>(std::make_shared<DeferredShader>())}) {
+                Scene scene;
+                scene.camera_obj = std::make_shared<CameraObject>();
+                scene.camera_obj->camera = Camera(40.0f, 1.0f, 0.1f, 1000.0f);
+                scene.camera_obj->SetPosition({0, 0.5, 5});
+                scene.frame_buffer = std::make_shared<FrameBuffer>(size, size);
+                scene.g_buffer = std::make_shared<GBuffer>(size, size);
+                scene.shader_list.push_back(shader);
+                scene.render_path = shader->name == "Deferred" ? DEFERRED : FORWARD;
+                scene.lights = {{.direction = {1, 1, 1}, .intensity = {1, 1, 1}}, {.direction = {-1, -1, -1}, .intensity = {1, 1, 1}}};
+                for (const auto &model : {head, eye}) {
+                    auto mesh_obj = std::make_shared<MeshObject>();
+                    mesh_obj->mesh = std::make_shared<Mesh>(model);
+                    scene.mesh_objs.push_back(mesh_obj);
+                }
+                for (const size_t threads : thread_counts) {
+                    ThreadPool::Instance().SetConcurrency(threads);
+                    runner.Run("frame", {{"scene", "african_head"}, {"shader", shader->name}, {"resolution", std::to_string(size)},
+                                         {"threads", std::to_string(threads)}}, 1, [&] {
+                        scene.frame_buffer->Clear();
+                        scene.g_buffer->Clear();
+                        scene.Render();
+                        scene.frame_buffer->Resolve();
+                    });
+                }
+                ThreadPool::Instance().SetConcurrency(0);
+            }
+        }
+    }
+
+    void BenchMultisample(BenchRunner &runner) {
+        // msaa frames of 512 x 512, against the 1024 x 1024 frame that 4x supersampling would render
+        constexpr size_t kSize = 512;
+        const auto head = std::make_shared<Model>(kHeadModel);
+        const auto eye = std::make_shared<Model>(kEyeModel);
+        for (const auto &[samples, size] : {std::pair<int, size_t>{1, kSize}, {2, kSize}, {4, kSize}, {8, kSize}, {1, kSize * 2}}) {
+            Scene scene;
+            scene.camera_obj = std::make_shared<CameraObject>();
+            scene.camera_obj->camera = Camera(40.0f, 1.0f, 0.1f, 1000.0f);
+            scene.camera_obj->SetPosition({0, 0.5, 5});
+            scene.frame_buffer = std::make_shared<FrameBuffer>(size, size);
+            scene.g_buffer = std::make_shared<GBuffer>(size, size);
+            scene.shader_list.push_back(std::make_shared<BlinnPhongShader>());
+            scene.msaa_samples = samples;
+            scene.lights = {{.direction = {1, 1, 1}, .intensity = {1, 1, 1}}, {.direction = {-1, -1, -1}, .intensity = {1, 1, 1}}};
+            for (const auto &model : {head, eye}) {
+                auto mesh_obj = std::make_shared<MeshObject>();
+                mesh_obj->mesh = std::make_shared<Mesh>(model);
+                scene.mesh_objs.push_back(mesh_obj);
+            }
+            const std::string mode = size == kSize ? (samples > 1 ? "msaa" : "none") : "ssaa";
+            const int factor = size == kSize ? samples : 4;
+            runner.Run("antialiasing", {{"scene", "african_head"}, {"mode", mode}, {"samples", std::to_string(factor)}}, 1, [&] {
+                scene.frame_buffer->Clear();
+                scene.g_buffer->Clear();
+                scene.Render();
+                scene.frame_buffer->Resolve();
+            });
+        }
+    }
+
+    void BenchDynamicResolution(BenchRunner &runner) {
+        // 1024 x 1024 frames rendered at a fraction of the size and upscaled
+        constexpr size_t kSize = 1024;
+        const auto head = std::make_shared<Model>(kHeadModel);
+        const auto eye = std::make_shared<Model>(kEyeModel);
+        for (const float scale : {1.0f, 0.75f, 0.5f}) {
+            Scene scene;
+            scene.camera_obj = std::make_shared<CameraObject>();
+            scene.camera_obj->camera = Camera(40.0f, 1.0f, 0.1f, 1000.0f);
+            scene.camera_obj->SetPosition({0, 0.5, 5});
+            scene.frame_buffer = std::make_shared<FrameBuffer>(kSize, kSize);
+            scene.g_buffer = std::make_shared<GBuffer>(kSize, kSize);
+            scene.shader_list.push_back(std::make_shared<BlinnPhongShader>());
+            scene.resolution_scale = scale;
+            scene.lights = {{.direction = {1, 1, 1}, .intensity = {1, 1, 1}}, {.direction = {-1, -1, -1}, .intensity = {1, 1, 1}}};
+            for (const auto &model : {head, eye}) {
+                auto mesh_obj = std::make_shared<MeshObject>();
+                mesh_obj->mesh = std::make_shared<Mesh>(model);
+                scene.mesh_objs.push_back(mesh_obj);
+            }
+            std::ostringstream scale_name;
+            scale_name << scale;
+            runner.Run("dynamic_resolution", {{"scene", "african_head"}, {"resolution", std::to_string(kSize)}, {"scale", scale_name.str()}}, 1, [&] {
+                scene.frame_buffer->Clear();
+                scene.g_buffer->Clear();
+                scene.Render();
+                scene.frame_buffer->Resolve();
+            });
+        }
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    std::string output;
+    size_t repetitions = 10;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        if (option == "--output") output = argv[i + 1];
+        else if (option == "--repetitions") repetitions = std::max(1, std::atoi(argv[i + 1]));
+        else LOG_WARNING("Bench - unknown option: " + option);
+    }
+    Log::Instance().SetLogLevel(Log::Level::LOG_WARNING); // model and tga loading log every call
+
+    BenchRunner runner(repetitions);
+    BenchModel(runner);
+    BenchTGA(runner);
+    BenchMaths(runner);
+    BenchRasterize(runner);
+    BenchShaders(runner);
+    BenchFrames(runner);
+    BenchMultisample(runner);
+    BenchDynamicResolution(runner);
+
+    if (output.empty()) {
+        runner.WriteJson(std::cout);
+        return 0;
+    }
+    std::ofstream out(output);
+    if (!out.is_open()) {
+        LOG_ERROR("Bench - cannot open output file: " + output);
+        return 1;
+    }
+    runner.WriteJson(out);
+    return 0;
+}